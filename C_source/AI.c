@@ -1,29 +1,286 @@
 #include "AI.h"
+#include "Bitboard.h"
+#include "Solver.h"
+#include "OpeningBook.h"
+#include "Evaluation.h"
+#include "Random.h"
 #include <math.h>
+#include <string.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
 
 #define kMAGIC_EXP 8
 #define kMAGIC_RAT 2
+#define kMAGIC_EVAL 16     // Static evaluation worth a whole win at the next step
+#define kBATCH_LANES 16    // Boards whose roots CPUsChoices() checks together
 #define nextPlayerIndex(_curr) ((_curr+1)%2)
 
-static int CPUinsertInColumnAtIndex(int indx, char player, Board *board);
-static BOOL CPUremoveFromColumnAtIndex(int indx, Board *board);
-static void traverse(Board *board, char players[], int turn, char cpuChar, int step, int maxSteps, double *fitness, int choiceIndex);
+static double stepWeights[kBOARDS_CELLS +2];
+
+static Arena arena;                 // The memory of every table below
+static BOOL reserved = false;
+static TranspositionTable table;
+static size_t tableBytes = kTT_DEFAULT_BYTES;
+static int searchThreads = 1;
+static const OpeningBook *openingBook = NULL;
+static const EndgameTable *endgameTable = NULL;
+static uint64_t lastSearchNodes = 0;
+static Random mistakes;             // The demo mistakes, see setCPUsSeed()
+static uint32_t mistakesOneIn = kERROR_FACTOR;
+
+#ifdef USE_SEARCH_STATS
+// By statsIndex(): easy, hard, expert
+static SearchStats cpuStats[3];
+static const char *cpuNames[3] = {"easy", "hard", "expert"};
+static SearchCounters lastCounters;
+static MoveSource lastSource;
+static int lastRootDiscs;
+#define statsIndex(_cpuChar) ((_cpuChar) == kCPU_EASY ? 0 : ((_cpuChar) == kCPU_HARD ? 1 : 2))
+#endif
+
+#ifdef USE_PTHREADS
+// Worker 0 is the calling thread and uses table
+static TranspositionTable workerTables[kMAX_SEARCH_THREADS];
+#endif
+
+// Answers of the CPU to the columns the human may play next. Arrays are by
+// index in replies.
+typedef struct {
+    BOOL active;
+    Position root;                  // The human to move
+    char players[2];
+    int turn;                       // The human's
+    int maxAiSteps;
+    int replies[kBOARDS_COLS];      // Likeliest first
+    int nReplies;
+    int next;                       // Being searched
+    int depth;                      // Of the EXPERT's searches
+    int answers[kBOARDS_COLS];      // -1 until searched
+    int scores[kBOARDS_COLS];
+    int depths[kBOARDS_COLS];
+} Ponder;
+
+static Ponder ponder;
+
+static int fixedDepthChoice(Board *board, char players[], int turn, int maxAiSteps, BOOL isDemo);
+static int deepeningChoice(Board *board, char players[], int turn, XTime deadline, BOOL isDemo, SearchReport *report);
+static void noteAnswer(MoveSource source, const Solver *solver, const Position *pos);
+#ifdef USE_SEARCH_STATS
+static void recordCPUsMove(char cpuChar, MoveSource source, const SearchCounters *counters, int rootDiscs, XTime tStart);
+#endif
+static void batchRootChoices(CPUsRequest requests[], int count, int answers[]);
+static int winningChoice(Position *pos, char players[], int turn, Bitboard wins);
+static void batchSearches(CPUsRequest requests[], int count, int answers[]);
+static int ponderedReply(const Position *pos, char players[], int turn);
+static void nextPonderedSearch();
+static int mistakenChoice(Board *board, char players[], int turn, BOOL isDemo);
+static void prepareSearch(Solver *solver, BOOL newSearch);
+static void releaseTables();
+static int bookChoice(Position *pos, char players[], int turn, int *score);
+static int choiceAtDepth(Solver *solver, Position *pos, char players[], int turn, int depth, int *score);
+static int serialChoiceAtDepth(Solver *solver, Position *pos, char players[], int turn, int depth, int *score);
+static double traverse(Solver *solver, Position *pos, char players[], int turn, char cpuChar, int step, int maxSteps, double *fitness);
+static double moveFitness(Solver *solver, Position *pos, char players[], int turn, char cpuChar, int step, int maxSteps, int col);
+static int fittestPlayable(Position *pos, double fitness[]);
 static int fittestIndex(double fitness[]);
-static char winningPlayerFromPosition(Board board, int xpos, int ypos);
+static void initStepWeights();
+
+#ifdef USE_PTHREADS
+static int parallelChoiceAtDepth(Solver *solver, Position *pos, char players[], int turn, int depth, int *score);
+#endif
 
 
 int CPUsChoice(Board *board, char players[], int turn, int maxAiSteps, BOOL isDemo) {
-    
-    XTime clk;  
-    XTime_GetTime(&clk);
+#ifdef USE_SEARCH_STATS
+    XTime tStart;
+    XTime_GetTime(&tStart);
+#endif
+    int ans = fixedDepthChoice(board, players, turn, maxAiSteps, isDemo);
+#ifdef USE_SEARCH_STATS
+    recordCPUsMove(players[turn], lastSource, &lastCounters, lastRootDiscs, tStart);
+#endif
+    CPUsPonderStop();
+    return ans;
+}
+
+int CPUsChoiceWithDeadline(Board *board, char players[], int turn, XTime deadline, BOOL isDemo, SearchReport *report) {
+#ifdef USE_SEARCH_STATS
+    XTime tStart;
+    XTime_GetTime(&tStart);
+#endif
+    int ans = deepeningChoice(board, players, turn, deadline, isDemo, report);
+#ifdef USE_SEARCH_STATS
+    recordCPUsMove(players[turn], lastSource, &lastCounters, lastRootDiscs, tStart);
+#endif
+    CPUsPonderStop();
+    return ans;
+}
+
+static int fixedDepthChoice(Board *board, char players[], int turn, int maxAiSteps, BOOL isDemo) {
+
+    int ans = mistakenChoice(board, players, turn, isDemo);
+    if (ans != -1) {
+        noteAnswer(MoveSourceMistake, NULL, NULL);
+        return ans;
+    }
+
+    Position pos;
+    positionFromBoard(&pos, board, players);
+
+    ans = bookChoice(&pos, players, turn, NULL);
+    if (ans != -1) {
+        noteAnswer(MoveSourceBook, NULL, &pos);
+        return ans;
+    }
+
+    // Pondered at this depth: done, or at least on a warm table
+    int reply = ponderedReply(&pos, players, turn);
+    BOOL warm = (reply != -1 && (players[turn] == kCPU_EXPERT || ponder.maxAiSteps == maxAiSteps));
+
+    if (warm && players[turn] != kCPU_EXPERT && ponder.answers[reply] != -1) {
+        noteAnswer(MoveSourcePonder, NULL, &pos);
+        return ponder.answers[reply];
+    }
+
+    Solver solver;
+    prepareSearch(&solver, !warm);
+
+    ans = choiceAtDepth(&solver, &pos, players, turn, maxAiSteps, NULL);
+    noteAnswer(MoveSourceSearch, &solver, &pos);
+
+    return ans;
+}
+
+static int deepeningChoice(Board *board, char players[], int turn, XTime deadline, BOOL isDemo, SearchReport *report) {
+
+    SearchReport dummy;
+    if (report == NULL) report = &dummy;
+
+    report->depthReached = 0;
+    report->score = 0;
+    report->nodes = 0;
+
+    int ans = mistakenChoice(board, players, turn, isDemo);
+    if (ans != -1) {
+        noteAnswer(MoveSourceMistake, NULL, NULL);
+        return ans;
+    }
+
+    Position pos;
+    positionFromBoard(&pos, board, players);
+
+    ans = bookChoice(&pos, players, turn, &report->score);
+    if (ans != -1) {
+        noteAnswer(MoveSourceBook, NULL, &pos);
+        return ans;
+    }
+
+    // Decided while pondering, or else searched again on the table it left
+    int reply = (players[turn] == kCPU_EXPERT ? ponderedReply(&pos, players, turn) : -1);
+
+    if (reply != -1 && ponder.answers[reply] != -1 && ponder.scores[reply] != 0) {
+        report->depthReached = ponder.depths[reply];
+        report->score = ponder.scores[reply];
+        noteAnswer(MoveSourcePonder, NULL, &pos);
+        return ponder.answers[reply];
+    }
+
+    Solver solver;
+    prepareSearch(&solver, reply == -1);
+
+    int i, depth;
+
+    // Fallback, in case not even depth 1 completes
+    for (i=0; i<kBOARDS_COLS; ++i) {
+        if (positionCanPlay(&pos, columnOrder(i))) {
+            ans = columnOrder(i);
+            break;
+        }
+    }
+
+    for (depth=1; depth<=board->emptyCells; ++depth) {
+
+        XTime tStart, tEnd;
+        int score = 0;
+
+        // Depth 1 always runs to the end, so there is always a searched answer
+        solver.deadline = (depth == 1 ? 0 : deadline);
+
+        XTime_GetTime(&tStart);
+
+        int choice = choiceAtDepth(&solver, &pos, players, turn, depth, &score);
+
+        XTime_GetTime(&tEnd);
+
+        report->timeOfDepth[depth] = (tEnd - tStart)*10000 /COUNTS_PER_SECOND;
+        report->nodes = solver.nodes;
+
+        if (solver.aborted) break;
+
+        ans = choice;
+        report->depthReached = depth;
+        report->score = score;
+
+        // A win or a loss found within the horizon won't change with more depth
+        if (players[turn] == kCPU_EXPERT && score != 0) break;
+
+        if (tEnd >= deadline) break;
+    }
+
+    noteAnswer(MoveSourceSearch, &solver, &pos);
+
+    return ans;
+}
+
+void CPUsChoices(CPUsRequest requests[], int count, int answers[]) {
+
+    int first;
+
+    // Tables and weights are set up once for the batch
+    Solver solver;
+    prepareSearch(&solver, true);
+
+    for (first=0; first<count; first+=kBATCH_LANES) {
+        int lanes = (count -first < kBATCH_LANES ? count -first : kBATCH_LANES);
+        batchRootChoices(&requests[first], lanes, &answers[first]);
+    }
+
+    batchSearches(requests, count, answers);
+}
+
+int CPUsChoiceWithinTime(Board *board, char players[], int turn, uint32_t budget_ms, BOOL isDemo, SearchReport *report) {
+
+    XTime now;
+    XTime_GetTime(&now);
+
+    return CPUsChoiceWithDeadline(board, players, turn, now +(XTime)budget_ms*COUNTS_PER_SECOND/1000, isDemo, report);
+}
+
+// Remembers where the last answer came from. solver is NULL if nothing was searched.
+static void noteAnswer(MoveSource source, const Solver *solver, const Position *pos) {
+
+    lastSearchNodes = (solver != NULL ? solver->nodes : 0);
+
+#ifdef USE_SEARCH_STATS
+    lastSource = source;
+    lastRootDiscs = (pos != NULL ? pos->nMoves : 0);
+    if (solver != NULL) lastCounters = solver->counters;
+#endif
+}
+
+// In demo mode, the CPUs deliberately play a random column once in a while.
+// Returns -1 when no mistake is made.
+static int mistakenChoice(Board *board, char players[], int turn, BOOL isDemo) {
 	
-    if (isDemo && (clk)%kERROR_FACTOR == 0) {
+    if (isDemo && mistakesOneIn > 0 && randomBelow(&mistakes, mistakesOneIn) == 0) {
 
-        xil_printf("Mistake made by CPU %s\n", (players[turn] == kCPU_HARD ? "HARD" : "EASY"));
+        xil_printf("Mistake made by CPU %s\n", (players[turn] == kCPU_HARD ? "HARD" : (players[turn] == kCPU_EASY ? "EASY" : "EXPERT")));
 
 		while (1) {
 
-			int ans = (rand()*clk)%kBOARDS_COLS;
+			int ans = randomBelow(&mistakes, kBOARDS_COLS);
 
 			if (canInsertInColumnAtIndex(ans, board)) {
 				return ans;
@@ -31,126 +288,627 @@ int CPUsChoice(Board *board, char players[], int turn, int maxAiSteps, BOOL isDe
 		}
 	}
 
-    double *fitness = calloc(kBOARDS_COLS, sizeof(double));
+    return -1;
+}
 
-    traverse(board, players, turn, players[turn], 1, maxAiSteps, fitness, -1);
+// Without newSearch, the fitness values left in the table by the last search
+// stay valid: only for the same CPU, depth and root, or its pondered parent.
+static void prepareSearch(Solver *solver, BOOL newSearch) {
 
-    int i, ans;
+    if (!reserved) CPUsReserve();
+    if (newSearch && table.entries != NULL) ttNewSearch(&table);
 
-    for (i=0; i<kBOARDS_COLS; ++i) {
+#ifdef USE_PTHREADS
+    int k;
+    for (k=1; k<searchThreads; ++k) {
+        if (workerTables[k].entries != NULL) ttNewSearch(&workerTables[k]);
+    }
+#endif
 
-        ans = fittestIndex(fitness);
-        if (canInsertInColumnAtIndex(ans, board)) break;
-        else {
-            fitness[ans] = INT32_MIN;
-        }
+    solverInit(solver, (table.entries != NULL ? &table : NULL));
+    solver->endgame = endgameTable;
+}
+
+// The easy CPU is meant to be weak, so it never gets book moves.
+static int bookChoice(Position *pos, char players[], int turn, int *score) {
+    if (openingBook == NULL || players[turn] == kCPU_EASY) return -1;
+    return bookLookup(openingBook, pos, turn, score);
+}
+
+// Runs the engine of players[turn] to the given depth. Returns -1 if the
+// solver's deadline interrupts it.
+static int choiceAtDepth(Solver *solver, Position *pos, char players[], int turn, int depth, int *score) {
+
+#ifdef USE_PTHREADS
+    if (searchThreads > 1) {
+        return parallelChoiceAtDepth(solver, pos, players, turn, depth, score);
     }
+#endif
 
-    free(fitness);
+    return serialChoiceAtDepth(solver, pos, players, turn, depth, score);
+}
 
-    return ans;
+static int serialChoiceAtDepth(Solver *solver, Position *pos, char players[], int turn, int depth, int *score) {
+
+    if (players[turn] == kCPU_EXPERT) {
+        return solverBestMove(solver, pos, turn, depth, score);
+    }
+
+    double fitness[kBOARDS_COLS] = {0};
+
+    traverse(solver, pos, players, turn, players[turn], 1, depth, fitness);
+
+    if (solver->aborted) return -1;
+
+    if (score != NULL) *score = 0;
+
+    return fittestPlayable(pos, fitness);
 }
 
-static void traverse(Board *board, char players[], int turn, char cpuChar, int step, int maxSteps, double *fitness, int choiceIndex) {
+// Returns the weighted wins and losses found below pos. At the root, the share
+// of each column is also added into fitness[].
+static double traverse(Solver *solver, Position *pos, char players[], int turn, char cpuChar, int step, int maxSteps, double *fitness) {
     
     int i;
+    int depth = maxSteps -step;
+    double sum = 0;
+
+    ++(solver->nodes);
+    statsCountNode(solver, pos);
+
+    if (solverOutOfTime(solver)) return 0;
+
+    if (fitness == NULL && depth >= kTT_MIN_DEPTH && solver->table != NULL) {
+        TTEntry *entry = ttProbe(solver->table, pos->key);
+        statsCount(solver, ttProbes);
+        if (entry != NULL && entry->type == TTValueFitness && entry->depth == depth) {
+            ttCountHit(solver->table);
+            statsCount(solver, ttHits);
+            statsCount(solver, ttCutoffs);
+            return entry->value;
+        }
+    }
+
+    if (pos->nMoves >= kBOARDS_CELLS) statsCount(solver, terminals);
+    else statsCount(solver, expanded);
     
     // For each column
     for (i=0; i<kBOARDS_COLS; ++i) {
         
-        if (step == 1) choiceIndex = i;
-        
-        int row = CPUinsertInColumnAtIndex(i, players[turn], board);
-
         // Tries to insert
-        if (row != -1) {
-            
-            // Inserted
-            char winningChar = winningPlayerFromPosition(*board, i, row);
+        if (positionCanPlay(pos, i)) {
             
-            if (winningChar == kCPU_HARD) {
-                
-                if (cpuChar == kCPU_HARD)
-                    fitness[choiceIndex] += pow(step, -(kMAGIC_EXP));
-                else
-                    fitness[choiceIndex] -= pow(step, -(kMAGIC_EXP)) *(kMAGIC_RAT);
-                
-            } else if (winningChar == kCPU_EASY) {
-                
-                if (cpuChar == kCPU_EASY)
-                    fitness[choiceIndex] += pow(step, -(kMAGIC_EXP));
-                else
-                    fitness[choiceIndex] -= pow(step, -(kMAGIC_EXP)) *(kMAGIC_RAT);
-                
-            } else if (winningChar == kPLAYER_1 || winningChar == kPLAYER_2) {
-                
-                fitness[choiceIndex] -= pow(step, -(kMAGIC_EXP)) *(kMAGIC_RAT);
-                
-            } else if ((step+1) <= maxSteps){
-                
-                // Recur
-                traverse(board, players, nextPlayerIndex(turn), cpuChar, step+1, maxSteps, fitness, choiceIndex);
-            }
-            
-            // Backtrack
-            CPUremoveFromColumnAtIndex(i, board);
+            statsCount(solver, children);
+
+            double branch = moveFitness(solver, pos, players, turn, cpuChar, step, maxSteps, i);
+
+            if (solver->aborted) return 0;
+
+            if (fitness != NULL) fitness[i] += branch;
+            sum += branch;
         }
     }
+
+    if (fitness == NULL && depth >= kTT_MIN_DEPTH && solver->table != NULL) {
+        ttStore(solver->table, pos->key, depth, TTValueFitness, sum, -1);
+    }
+
+    return sum;
 }
 
-static char winningPlayerFromPosition(Board board, int xpos, int ypos) {
+// Wins, losses and horizons are nodes too, as in the Solver, so that nodes
+// compare across engines. Checking the clock at every count keeps it
+// checked every 1024 nodes.
+static inline void countLeaf(Solver *solver, Position *pos) {
+    ++(solver->nodes);
+    statsCountNode(solver, pos);
+    solverOutOfTime(solver);
+}
+
+// Weight of the win, loss, or subtree that playing col leads to.
+static double moveFitness(Solver *solver, Position *pos, char players[], int turn, char cpuChar, int step, int maxSteps, int col) {
+
+    double branch = 0;
 
-    if (board.matrix == NULL) {
-        return kEMPTY;
+    positionPlay(pos, col, turn);
+
+    // Only the player who just moved can have completed a line
+    if (bitboardHasAlignment(pos->discs[turn])) {
+
+        countLeaf(solver, pos);
+        statsCount(solver, terminals);
+
+        if (players[turn] == cpuChar)
+            branch = stepWeights[step];
+        else
+            branch = -stepWeights[step] *(kMAGIC_RAT);
+
+    } else if ((step+1) <= maxSteps){
+
+        // Recur
+        branch = traverse(solver, pos, players, nextPlayerIndex(turn), cpuChar, step+1, maxSteps, NULL);
+
+    } else {
+
+        countLeaf(solver, pos);
+        statsCount(solver, horizons);
+
+        // Left open: a fraction of a win one step further, by the static evaluation
+        int value = evaluatePosition(pos, nextPlayerIndex(turn));
+        if (players[nextPlayerIndex(turn)] != cpuChar) value = -value;
+
+        branch = stepWeights[step+1] *value /kMAGIC_EVAL;
     }
 
-    
-    int offsetNew[2][4] = {{ 1, 1, 1, 0},
-                           {-1, 1, 0, 1}};
+    // Backtrack
+    positionUndo(pos, col, turn);
 
-    int k, s, iters;
+    return branch;
+}
+
+// Roots of up to kBATCH_LANES boards, one step at a time for all of them:
+// answers the ones with a book move or a win, and leaves -1 for the others.
+static void batchRootChoices(CPUsRequest requests[], int count, int answers[]) {
+
+    Position pos[kBATCH_LANES];
+    Bitboard wins[kBATCH_LANES];
+    int i;
+
+    for (i=0; i<count; ++i) {
+        positionFromBoard(&pos[i], requests[i].board, requests[i].players);
+    }
+
+    for (i=0; i<count; ++i) {
+        wins[i] = bitboardWinningCells(pos[i].discs[requests[i].turn]) & positionPlayableCells(&pos[i]);
+    }
+
+    for (i=0; i<count; ++i) {
+#ifdef USE_SEARCH_STATS
+        XTime tStart;
+        XTime_GetTime(&tStart);
+        char cpuChar = requests[i].players[requests[i].turn];
+#endif
+        answers[i] = bookChoice(&pos[i], requests[i].players, requests[i].turn, NULL);
+#ifdef USE_SEARCH_STATS
+        if (answers[i] != -1) recordCPUsMove(cpuChar, MoveSourceBook, NULL, pos[i].nMoves, tStart);
+#endif
+        if (answers[i] != -1 || wins[i] == 0) continue;
+
+        answers[i] = winningChoice(&pos[i], requests[i].players, requests[i].turn, wins[i]);
+#ifdef USE_SEARCH_STATS
+        recordCPUsMove(cpuChar, MoveSourceSearch, NULL, pos[i].nMoves, tStart);
+#endif
+    }
+}
 
-    // The player in the current position
-    char player = board.matrix[ypos][xpos];
-    if (player == kEMPTY) return kEMPTY;
+// The winning column the search would pick: the fitness engines take the
+// first, the solver the one closest to the center.
+static int winningChoice(Position *pos, char players[], int turn, Bitboard wins) {
 
-    // For each possible direction
-    for (k=0; k<4; ++k) {
+    int i;
 
-        int i_off = offsetNew[0][k];
-        int j_off = offsetNew[1][k];
+    for (i=0; i<kBOARDS_COLS; ++i) {
+        int col = (players[turn] == kCPU_EXPERT ? columnOrder(i) : i);
+        if (positionCanPlay(pos, col) && (wins & bitForCell(col, pos->heights[col]))) return col;
+    }
 
-        int span = 1;
+    return -1;
+}
 
-        // For each step in the same direction
-        for (s=0; s<=1; ++s) {
+#ifdef USE_PTHREADS
+#define batchLock(_batch) pthread_mutex_lock(&(_batch)->lock)
+#define batchUnlock(_batch) pthread_mutex_unlock(&(_batch)->lock)
+#else
+#define batchLock(_batch) ((void)0)
+#define batchUnlock(_batch) ((void)0)
+#endif
 
-            int theSign = (s==0 ? 1 : -1);
+// Boards left unanswered by the roots are handed out whole, one at a time.
+typedef struct {
+#ifdef USE_PTHREADS
+    pthread_mutex_t lock;
+#endif
+    CPUsRequest *requests;
+    int *answers;
+    int count;
+    int next;
+    uint64_t nodes;
+} Batch;
 
-            for (iters = 1; iters<=kBOARDS_COLS; ++iters) {
+typedef struct {
+    Batch *batch;
+    TranspositionTable *table;
+#ifdef USE_PTHREADS
+    pthread_t thread;
+#endif
+} BatchWorker;
 
-                int i_cur = ypos +theSign*(i_off*iters);
-                int j_cur = xpos +theSign*(j_off*iters);
+static void* batchWorkerMain(void *arg) {
 
-                // Invalid position. Useless to continue.
-                if (i_cur < 0 || j_cur < 0 || i_cur >= kBOARDS_ROWS || j_cur >= kBOARDS_COLS) {
-                    break;
-                }
+    BatchWorker *worker = (BatchWorker *) arg;
+    Batch *batch = worker->batch;
 
-                if (board.matrix[i_cur][j_cur] != player) {
-                    break;
-                }
+    while (true) {
 
-                span += 1;
-            }
+        batchLock(batch);
+        while (batch->next < batch->count && batch->answers[batch->next] != -1) ++(batch->next);
+        int i = batch->next++;
+        batchUnlock(batch);
+
+        if (i >= batch->count) break;
+
+        CPUsRequest *request = &batch->requests[i];
+#ifdef USE_SEARCH_STATS
+        XTime tStart;
+        XTime_GetTime(&tStart);
+#endif
+        // Fitness entries are only valid within one search
+        if (worker->table->entries != NULL) ttNewSearch(worker->table);
+
+        Solver solver;
+        solverInit(&solver, (worker->table->entries != NULL ? worker->table : NULL));
+        solver.endgame = endgameTable;
+
+        Position pos;
+        positionFromBoard(&pos, request->board, request->players);
+
+        batch->answers[i] = serialChoiceAtDepth(&solver, &pos, request->players, request->turn, request->maxAiSteps, NULL);
+
+        batchLock(batch);
+        batch->nodes += solver.nodes;
+#ifdef USE_SEARCH_STATS
+        recordCPUsMove(request->players[request->turn], MoveSourceSearch, &solver.counters, pos.nMoves, tStart);
+#endif
+        batchUnlock(batch);
+    }
+
+    return NULL;
+}
+
+static void batchSearches(CPUsRequest requests[], int count, int answers[]) {
+
+    Batch batch;
+    BatchWorker workers[kMAX_SEARCH_THREADS];
+
+    batch.requests = requests;
+    batch.answers = answers;
+    batch.count = count;
+    batch.next = 0;
+    batch.nodes = 0;
+
+    workers[0].batch = &batch;
+    workers[0].table = &table;
+
+#ifdef USE_PTHREADS
+    int k, started = 1;
+
+    pthread_mutex_init(&batch.lock, NULL);
+
+    // Falls back to fewer threads if some can't be started
+    for (k=1; k<searchThreads; ++k) {
+        workers[k].batch = &batch;
+        workers[k].table = &workerTables[k];
+        if (pthread_create(&workers[k].thread, NULL, batchWorkerMain, &workers[k]) != 0) break;
+        ++started;
+    }
+#endif
+
+    batchWorkerMain(&workers[0]);
+
+#ifdef USE_PTHREADS
+    for (k=1; k<started; ++k) {
+        pthread_join(workers[k].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+#endif
+
+    lastSearchNodes = batch.nodes;
+}
+
+void CPUsPonderStart(Board *board, char players[], int turn, int maxAiSteps) {
+
+    int cpu = nextPlayerIndex(turn);
+    int values[kBOARDS_COLS];
+    int i, j, n = 0;
+
+    Solver solver;
+    prepareSearch(&solver, true);
+
+    positionFromBoard(&ponder.root, board, players);
+    ponder.players[0] = players[0];
+    ponder.players[1] = players[1];
+    ponder.turn = turn;
+    ponder.maxAiSteps = maxAiSteps;
+    ponder.next = 0;
+    ponder.depth = 1;
+
+    // Likeliest are the columns the static evaluation likes best for the
+    // human. Columns that end the game leave the CPU nothing to answer.
+    for (i=0; i<kBOARDS_COLS; ++i) {
+
+        int col = columnOrder(i);
+
+        if (!positionCanPlay(&ponder.root, col) || positionIsWinningMove(&ponder.root, col, turn)) continue;
+        if (ponder.root.nMoves +1 >= kBOARDS_CELLS) continue;
+
+        positionPlay(&ponder.root, col, turn);
+        int value = evaluatePosition(&ponder.root, cpu);
+        positionUndo(&ponder.root, col, turn);
+
+        // Stable, so ties stay center first
+        for (j=n; j>0 && values[j-1] > value; --j) {
+            values[j] = values[j-1];
+            ponder.replies[j] = ponder.replies[j-1];
+        }
+        values[j] = value;
+        ponder.replies[j] = col;
+        ++n;
+    }
+
+    for (i=0; i<n; ++i) {
+        ponder.answers[i] = -1;
+        ponder.scores[i] = 0;
+        ponder.depths[i] = 0;
+    }
+
+    ponder.nReplies = n;
+    ponder.active = (n > 0);
+}
+
+uint32_t CPUsPonder(uint32_t budget_us) {
+
+    XTime tStart, now;
+
+    if (!ponder.active || ponder.next >= ponder.nReplies) return 0;
+
+    XTime_GetTime(&tStart);
+    now = tStart;
+
+    int cpu = nextPlayerIndex(ponder.turn);
+    XTime deadline = tStart +(XTime)budget_us*COUNTS_PER_SECOND/1000000;
+
+    while (ponder.next < ponder.nReplies && now < deadline) {
+
+        Solver solver;
+        solverInit(&solver, (table.entries != NULL ? &table : NULL));
+        solver.endgame = endgameTable;
+        solver.deadline = deadline;
+
+        Position pos = ponder.root;
+        positionPlay(&pos, ponder.replies[ponder.next], ponder.turn);
+
+        int score = 0;
+        int ans;
+
+        if (ponder.players[cpu] == kCPU_EXPERT) ans = solverBestMove(&solver, &pos, cpu, ponder.depth, &score);
+        else ans = serialChoiceAtDepth(&solver, &pos, ponder.players, cpu, ponder.maxAiSteps, NULL);
+
+        // What was finished is in the table: the next slice goes on from there
+        if (solver.aborted) break;
+
+        ponder.answers[ponder.next] = ans;
+        ponder.scores[ponder.next] = score;
+        ponder.depths[ponder.next] = ponder.depth;
+        nextPonderedSearch();
+
+        XTime_GetTime(&now);
+    }
+
+    XTime_GetTime(&now);
+
+    return (uint32_t)((now -tStart)*1000000 /COUNTS_PER_SECOND);
+}
+
+void CPUsPonderStop() {
+    ponder.active = false;
+}
+
+void CPUsPonderPlayed(int col) {
+
+    int i;
+
+    if (!ponder.active) return;
+
+    for (i=0; i<ponder.nReplies && ponder.replies[i] != col; ++i);
+
+    // Ends the game, or isn't even playable
+    if (i == ponder.nReplies) {
+        ponder.active = false;
+        return;
+    }
+
+    ponder.replies[0] = col;
+    ponder.answers[0] = ponder.answers[i];
+    ponder.scores[0] = ponder.scores[i];
+    ponder.depths[0] = ponder.depths[i];
+    ponder.nReplies = 1;
+
+    // The EXPERT deepens it further unless it's decided
+    if (ponder.players[nextPlayerIndex(ponder.turn)] == kCPU_EXPERT) {
+        ponder.depth = ponder.depths[0] +1;
+        ponder.next = (ponder.scores[0] != 0 || ponder.depth > kBOARDS_CELLS -ponder.root.nMoves -1 ? 1 : 0);
+    } else {
+        ponder.next = (ponder.answers[0] != -1 ? 1 : 0);
+    }
+}
+
+// Index in ponder.replies of the human's column that led to pos, -1 if pos
+// isn't the answer to any of them.
+static int ponderedReply(const Position *pos, char players[], int turn) {
+
+    int human = ponder.turn;
+    int i;
+
+    if (!ponder.active || turn == human || players[0] != ponder.players[0] || players[1] != ponder.players[1]) return -1;
+    if (pos->discs[turn] != ponder.root.discs[turn]) return -1;
+
+    Bitboard added = pos->discs[human] & ~ponder.root.discs[human];
+    if ((ponder.root.discs[human] & ~pos->discs[human]) != 0) return -1;
+
+    for (i=0; i<ponder.nReplies; ++i) {
+        int col = ponder.replies[i];
+        if (added == bitForCell(col, ponder.root.heights[col])) return i;
+    }
+
+    return -1;
+}
+
+// The fitness engines search each answer once. The EXPERT deepens them all
+// by one depth at a time, except those already decided.
+static void nextPonderedSearch() {
+
+    int maxDepth = kBOARDS_CELLS -ponder.root.nMoves -1;
+
+    if (ponder.players[nextPlayerIndex(ponder.turn)] != kCPU_EXPERT) {
+        ++(ponder.next);
+        return;
+    }
+
+    do {
+        if (++(ponder.next) == ponder.nReplies) {
+            if (ponder.depth >= maxDepth) return;
+            ponder.next = 0;
+            ++(ponder.depth);
+        }
+    } while (ponder.scores[ponder.next] != 0);
+}
+
+void setCPUsSeed(uint64_t seed) {
+    randomSeed(&mistakes, seed);
+}
+
+void setCPUsMistakes(uint32_t oneIn) {
+    mistakesOneIn = oneIn;
+}
+
+void setCPUsMemoryBudget(size_t bytes) {
+    tableBytes = bytes;
+    releaseTables();
+}
+
+// Without enough memory for every table, the last threads search without one.
+void CPUsReserve() {
+
+    releaseTables();
+
+    initStepWeights();
+
+    if (arenaInit(&arena, ttFootprint(tableBytes)*searchThreads)) {
+        ttInitInArena(&table, &arena, tableBytes);
+#ifdef USE_PTHREADS
+        int k;
+        for (k=1; k<searchThreads; ++k) ttInitInArena(&workerTables[k], &arena, tableBytes);
+#endif
+    }
+
+    reserved = true;
+}
+
+static void releaseTables() {
+
+    ttFree(&table);
+#ifdef USE_PTHREADS
+    int k;
+    for (k=1; k<kMAX_SEARCH_THREADS; ++k) ttFree(&workerTables[k]);
+#endif
+    arenaFree(&arena);
+
+    reserved = false;
+}
+
+void setCPUsOpeningBook(const OpeningBook *book) {
+    openingBook = book;
+}
+
+void setCPUsEndgameTable(const EndgameTable *endgame) {
+    endgameTable = endgame;
+}
+
+// Without USE_PTHREADS the search always runs on the calling thread.
+void setCPUsThreads(int threads) {
+#ifdef USE_PTHREADS
+    if (threads > kMAX_SEARCH_THREADS) threads = kMAX_SEARCH_THREADS;
+    if (threads < 1) threads = 1;
+    if (threads != searchThreads) releaseTables();
+    searchThreads = threads;
+#else
+    searchThreads = 1;
+#endif
+}
+
+int CPUsThreads() {
+    return searchThreads;
+}
+
+const TranspositionTable* CPUsTranspositionTable() {
+    return &table;
+}
+
+uint64_t CPUsLastSearchNodes() {
+    return lastSearchNodes;
+}
+
+#ifdef USE_SEARCH_STATS
+
+// Adds a move to the totals of cpuChar. counters are only used for searched moves.
+static void recordCPUsMove(char cpuChar, MoveSource source, const SearchCounters *counters, int rootDiscs, XTime tStart) {
+
+    XTime tEnd;
+    XTime_GetTime(&tEnd);
+
+    searchStatsAddMove(&cpuStats[statsIndex(cpuChar)], source,
+                       (source == MoveSourceSearch ? counters : NULL), rootDiscs,
+                       (uint64_t)(tEnd -tStart)*1000000 /COUNTS_PER_SECOND);
+}
+
+const SearchStats* CPUsSearchStats(char cpuChar) {
+    return &cpuStats[statsIndex(cpuChar)];
+}
+
+void resetCPUsSearchStats() {
+    memset(cpuStats, 0, sizeof(cpuStats));
+}
+
+// Players that haven't moved are left out.
+void printCPUsSearchStats(BOOL asJSON) {
+
+    int i, n = 0;
+
+    if (asJSON) xil_printf("{\"cpus\": [\n");
+    else xil_printf("player,metric,value\n");
+
+    for (i=0; i<3; ++i) {
+
+        if (cpuStats[i].moves == 0) continue;
+
+        if (asJSON) {
+            if (n++ > 0) xil_printf(",\n");
+            searchStatsPrintJSON(&cpuStats[i], cpuNames[i]);
+        } else {
+            searchStatsPrintCSV(&cpuStats[i], cpuNames[i]);
         }
+    }
+
+    if (asJSON) xil_printf("\n]}\n");
+}
 
-        if (span >= kLEN_TO_WIN) {
-            return player;
+#endif
+
+static int fittestPlayable(Position *pos, double fitness[]) {
+
+    int i, ans;
+
+    for (i=0; i<kBOARDS_COLS; ++i) {
+
+        ans = fittestIndex(fitness);
+        if (positionCanPlay(pos, ans)) break;
+        else {
+            fitness[ans] = INT32_MIN;
         }
     }
 
-    return kEMPTY;
+    return ans;
 }
 
 static int fittestIndex(double fitness[]) {
@@ -161,32 +919,193 @@ static int fittestIndex(double fitness[]) {
     return best_i;
 }
 
-static int CPUinsertInColumnAtIndex(int indx, char player, Board *board) {
-    if (indx < 0|| indx >= kBOARDS_COLS || board->matrix[0][indx] != kEMPTY) {
-        return -1;
-    }
+// pow(step, -kMAGIC_EXP) for every reachable step, computed once.
+static void initStepWeights() {
+    static BOOL ready = false;
+    if (ready) return;
     int i;
-    for (i = kBOARDS_ROWS -1; i>=0; --i) {
-        if (board->matrix[i][indx] == kEMPTY) {
-            board->matrix[i][indx] = player;
-            --(board->emptyCells);
-            return i;
+    stepWeights[0] = 0;
+    for (i=1; i<kBOARDS_CELLS +2; ++i) {
+        stepWeights[i] = pow(i, -(kMAGIC_EXP));
+    }
+    ready = true;
+}
+
+#ifdef USE_PTHREADS
+
+// Root moves are handed out one at a time, from the center out, to workers
+// that each search their own copy of the position with their own table.
+typedef struct {
+    pthread_mutex_t lock;
+    const Position *root;
+    char *players;
+    int turn, depth;
+    XTime deadline;
+    int nextMove;                   // Index in columnOrder()
+    int alpha;                      // Best exact solver score so far
+    int scores[kBOARDS_COLS];
+    BOOL exact[kBOARDS_COLS];
+    double fitness[kBOARDS_COLS];
+    uint64_t nodes;
+    BOOL aborted;
+#ifdef USE_SEARCH_STATS
+    SearchCounters counters;
+#endif
+} RootSplit;
+
+typedef struct {
+    RootSplit *split;
+    TranspositionTable *table;
+    pthread_t thread;
+} RootWorker;
+
+static void* rootWorkerMain(void *arg) {
+
+    RootWorker *worker = (RootWorker *) arg;
+    RootSplit *split = worker->split;
+    char cpuChar = split->players[split->turn];
+
+    Position pos = *split->root;
+
+    Solver solver;
+    solverInit(&solver, (worker->table->entries != NULL ? worker->table : NULL));
+    solver.endgame = endgameTable;
+    solver.deadline = split->deadline;
+
+    while (!solver.aborted) {
+
+        pthread_mutex_lock(&split->lock);
+        int i = split->nextMove++;
+        int alpha = split->alpha;
+        BOOL stop = split->aborted;
+        pthread_mutex_unlock(&split->lock);
+
+        if (i >= kBOARDS_COLS || stop) break;
+
+        int col = columnOrder(i);
+        if (!positionCanPlay(&pos, col)) continue;
+
+        if (cpuChar == kCPU_EXPERT) {
+
+            positionPlay(&pos, col, split->turn);
+            int value = -solverNegamax(&solver, &pos, nextPlayerIndex(split->turn), split->depth -1, -kSCORE_INFINITY, -alpha);
+            positionUndo(&pos, col, split->turn);
+
+            if (solver.aborted) break;
+
+            // Scores <= the alpha they were searched with are only upper bounds
+            pthread_mutex_lock(&split->lock);
+            split->scores[col] = value;
+            split->exact[col] = (value > alpha);
+            if (value > alpha && value > split->alpha) split->alpha = value;
+            pthread_mutex_unlock(&split->lock);
+
+        } else {
+
+            double branch = moveFitness(&solver, &pos, split->players, split->turn, cpuChar, 1, split->depth, col);
+
+            if (solver.aborted) break;
+
+            split->fitness[col] = branch;
         }
     }
-    return -1;
+
+    pthread_mutex_lock(&split->lock);
+    split->nodes += solver.nodes;
+    if (solver.aborted) split->aborted = true;
+#ifdef USE_SEARCH_STATS
+    searchCountersAdd(&split->counters, &solver.counters);
+#endif
+    pthread_mutex_unlock(&split->lock);
+
+    return NULL;
 }
 
-static BOOL CPUremoveFromColumnAtIndex(int indx, Board *board) {
-    if (indx < 0|| indx >= kBOARDS_COLS || board->matrix[kBOARDS_ROWS -1][indx] == kEMPTY) {
-        return false;
+// Same answer as the single-threaded search for the fitness engines. For the
+// solver, the score is the same but ties between columns may be broken
+// differently from run to run.
+static int parallelChoiceAtDepth(Solver *solver, Position *pos, char players[], int turn, int depth, int *score) {
+
+    int i, k;
+    RootSplit split;
+    RootWorker workers[kMAX_SEARCH_THREADS];
+
+    if (players[turn] == kCPU_EXPERT) {
+        for (i=0; i<kBOARDS_COLS; ++i) {
+            int col = columnOrder(i);
+            if (positionCanPlay(pos, col) && positionIsWinningMove(pos, col, turn)) {
+                if (score != NULL) *score = scoreForWinAt(pos->nMoves);
+                return col;
+            }
+        }
     }
-    int i;
-    for (i = 0; i < kBOARDS_ROWS; ++i) {
-        if (board->matrix[i][indx] != kEMPTY) {
-            board->matrix[i][indx] = kEMPTY;
-            ++(board->emptyCells);
-            return true;
+
+    pthread_mutex_init(&split.lock, NULL);
+    split.root = pos;
+    split.players = players;
+    split.turn = turn;
+    split.depth = depth;
+    split.deadline = solver->deadline;
+    split.nextMove = 0;
+    split.alpha = -kSCORE_INFINITY;
+    split.nodes = 0;
+    split.aborted = false;
+#ifdef USE_SEARCH_STATS
+    memset(&split.counters, 0, sizeof(SearchCounters));
+#endif
+
+    for (i=0; i<kBOARDS_COLS; ++i) {
+        split.scores[i] = -kSCORE_INFINITY;
+        split.exact[i] = false;
+        split.fitness[i] = 0;
+    }
+
+    for (k=0; k<searchThreads; ++k) {
+        workers[k].split = &split;
+        workers[k].table = (k == 0 ? &table : &workerTables[k]);
+    }
+
+    // Falls back to fewer threads if some can't be started
+    int started = 1;
+    for (k=1; k<searchThreads; ++k) {
+        if (pthread_create(&workers[k].thread, NULL, rootWorkerMain, &workers[k]) != 0) break;
+        ++started;
+    }
+
+    rootWorkerMain(&workers[0]);
+
+    for (k=1; k<started; ++k) {
+        pthread_join(workers[k].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&split.lock);
+
+    solver->nodes += split.nodes;
+#ifdef USE_SEARCH_STATS
+    searchCountersAdd(&solver->counters, &split.counters);
+#endif
+    if (split.aborted) {
+        solver->aborted = true;
+        return -1;
+    }
+
+    if (players[turn] != kCPU_EXPERT) {
+        if (score != NULL) *score = 0;
+        return fittestPlayable(pos, split.fitness);
+    }
+
+    int best = -1;
+
+    for (i=0; i<kBOARDS_COLS; ++i) {
+        int col = columnOrder(i);
+        if (positionCanPlay(pos, col) && split.exact[col] && (best == -1 || split.scores[col] > split.scores[best])) {
+            best = col;
         }
     }
-    return false;
+
+    if (score != NULL) *score = split.scores[best];
+
+    return best;
 }
+
+#endif
@@ -2,7 +2,97 @@
 #define AI
 
 #include "Constants.h"
+#include "TranspositionTable.h"
+#include "OpeningBook.h"
+#include "EndgameTable.h"
+#include "SearchStats.h"
+
+typedef struct {
+    int depthReached;       // Last depth searched to the end
+    int score;              // Solver score at that depth (EXPERT only)
+    uint64_t nodes;
+    uint32_t timeOfDepth[kBOARDS_CELLS +1]; // in 1/10 ms. The entry after depthReached is the interrupted iteration.
+} SearchReport;
 
 int CPUsChoice(Board *board, char players[], int turn,int maxAiSteps, BOOL isDemo);
 
+// A board waiting for the move of players[turn], for CPUsChoices()
+typedef struct {
+    Board *board;
+    char *players;
+    int turn;
+    int maxAiSteps;
+} CPUsRequest;
+
+// Answers many independent boards in one call, each with the column that
+// CPUsChoice() would give it with one thread and no demo mistakes. Meant for
+// moves per second over the batch: the roots of the boards are checked for
+// book moves and wins together, and with more than one thread every thread
+// searches whole boards instead of sharing the root moves of one.
+void CPUsChoices(CPUsRequest requests[], int count, int answers[]);
+
+// Iterative deepening: searches depth 1, 2, 3... and returns the choice of the
+// last depth that completed before the deadline (an XTime_GetTime value).
+int CPUsChoiceWithDeadline(Board *board, char players[], int turn, XTime deadline, BOOL isDemo, SearchReport *report);
+int CPUsChoiceWithinTime(Board *board, char players[], int turn, uint32_t budget_ms, BOOL isDemo, SearchReport *report);
+
+// Pondering: while a human thinks, the CPU searches its answers to their
+// likeliest columns, a slice at a time, so that CPUsChoice*() finds them
+// done or on a warm table. Start it at the human's turn; turn is theirs and
+// maxAiSteps the depth the CPU will search to (unused by the EXPERT, which
+// deepens every answer in turn). CPUsPonder() searches for up to budget_us
+// microseconds, a bit more if a search completes late, and returns the time
+// it took, 0 once there is nothing left to search. The next CPUsChoice*()
+// call, or CPUsPonderStop(), ends it.
+void CPUsPonderStart(Board *board, char players[], int turn, int maxAiSteps);
+uint32_t CPUsPonder(uint32_t budget_us);
+void CPUsPonderStop();
+
+// The human played col: only the answer to it is searched from then on, e.g.
+// while their disc falls.
+void CPUsPonderPlayed(int col);
+
+// Demo mistakes are drawn from a generator with this seed: from the same
+// seed, the same CPU calls make the same mistakes. Set it at every game.
+void setCPUsSeed(uint64_t seed);
+
+// In demo mode, a CPU plays a random column once in oneIn moves (0 for
+// never), kERROR_FACTOR until set.
+void setCPUsMistakes(uint32_t oneIn);
+
+// The tables are (re)allocated with the new budget by the next CPUsReserve().
+// With more than one thread, every worker gets a table of this size.
+void setCPUsMemoryBudget(size_t bytes);
+
+// Takes all the memory the CPUs search with, a table per thread, in one
+// block. From then on no move allocates anything. The first CPUsChoice*()
+// does it if it wasn't done before; calling it at startup keeps the
+// allocation off the first move. A new budget or thread count undoes it.
+void CPUsReserve();
+
+// Positions found in the book are answered without searching. NULL disables it.
+void setCPUsOpeningBook(const OpeningBook *book);
+
+// The EXPERT search stops at positions found in the table. NULL disables it.
+void setCPUsEndgameTable(const EndgameTable *endgame);
+
+// Root moves are split among the threads. Needs a build with USE_PTHREADS.
+void setCPUsThreads(int threads);
+int CPUsThreads();
+const TranspositionTable* CPUsTranspositionTable();
+
+// Nodes visited by the last CPUsChoice*() call, 0 if it didn't search. For
+// CPUsChoices(), those of the whole batch.
+uint64_t CPUsLastSearchNodes();
+
+#ifdef USE_SEARCH_STATS
+// Every CPUsChoice*() call is added to the totals of players[turn] (kCPU_EASY,
+// kCPU_HARD or kCPU_EXPERT), which are kept until reset.
+const SearchStats* CPUsSearchStats(char cpuChar);
+void resetCPUsSearchStats();
+
+// All the CPUs that moved since the reset, as JSON or CSV, through xil_printf.
+void printCPUsSearchStats(BOOL asJSON);
+#endif
+
 #endif
@@ -0,0 +1,205 @@
+#include "Animation.h"
+#include "Drawer.h"
+#include "math.h"
+
+#define kEASING_STEPS       256     // Table entries per unit of progress
+#define kFALL_PIXELS        512     // Longest fall in the falling table
+#define kFRAMES_PER_SECOND  60
+#define kMETERS_PER_PIXEL   0.0005703125
+
+typedef struct {
+    BOOL active;
+    int slot;
+    uint8_t color, shape;
+    Point from, to;
+    AnimationType type;
+    uint32_t frame, nFrames;
+} Animation;
+
+static int32_t easing[AnimationTypeGravity +1][kEASING_STEPS +1];
+static uint8_t fallFrames[kFALL_PIXELS];
+static Animation animations[kMAX_ANIMATIONS];
+static int nRunning;
+static XTime nextFrame;
+
+static float factorForAnimation(AnimationType animType, float progress);
+static void drawAnimation(Animation *anim);
+
+void animationInit() {
+
+    int t, i;
+
+    for (t=AnimationTypeLin; t<=AnimationTypeGravity; ++t) {
+        for (i=0; i<=kEASING_STEPS; ++i) {
+            easing[t][i] = (int32_t)lround(factorForAnimation(t, (float)i/kEASING_STEPS) *kEASING_ONE);
+        }
+    }
+
+    // Free fall from rest, at the scale of the board
+    for (i=0; i<kFALL_PIXELS; ++i) {
+        fallFrames[i] = (uint8_t)(sqrt(2*i*kMETERS_PER_PIXEL /9.8) *kFRAMES_PER_SECOND);
+    }
+
+    cancelAnimations();
+    nextFrame = 0;
+}
+
+int32_t easingFactor(AnimationType animType, int32_t progress) {
+
+    if (animType < AnimationTypeLin || animType > AnimationTypeGravity) return 0;
+
+    // Every curve is odd but the cosh, which is even
+    int32_t p = (progress < 0 ? -progress : progress);
+    int32_t sign = (progress < 0 && animType != AnimationTypeCosh ? -1 : 1);
+
+    if (p >= kEASING_ONE) return sign *easing[animType][kEASING_STEPS];
+
+    // Linear between entries
+    int32_t scaled = p *kEASING_STEPS;
+    int i = scaled /kEASING_ONE;
+    int32_t frac = scaled %kEASING_ONE;
+    int32_t a = easing[animType][i], b = easing[animType][i+1];
+
+    return sign *(a +(int32_t)(((int64_t)(b -a)*frac) /kEASING_ONE));
+}
+
+void animateShape(uint8_t color, uint8_t shape, int slot, Point from, Point to, AnimationType animType, float duration_s) {
+
+    int i, free = -1;
+
+    for (i=0; i<kMAX_ANIMATIONS; ++i) {
+        if (animations[i].active && animations[i].slot == slot) break;
+        if (!animations[i].active && free == -1) free = i;
+    }
+    if (i == kMAX_ANIMATIONS) i = free;
+
+    Animation anim;
+    anim.active = true;
+    anim.slot = slot;
+    anim.color = color;
+    anim.shape = shape;
+    anim.from = from;
+    anim.to = to;
+    anim.type = animType;
+    anim.frame = 0;
+
+    if (animType == AnimationTypeGravity) {
+        int dy = abs(to.y -from.y);
+        anim.nFrames = fallFrames[(dy < kFALL_PIXELS ? dy : kFALL_PIXELS -1)];
+    } else {
+        anim.nFrames = duration_s *kFRAMES_PER_SECOND;
+    }
+
+#ifdef HEADLESS
+    // Straight to the last frame
+    anim.nFrames = 0;
+#endif
+
+    // Without a free animation, or a frame to take, it's over at once
+    if (i == -1 || anim.nFrames == 0) {
+        displaySet(slot, encodeShape(to.x, to.y, color, shape));
+        if (i != -1 && animations[i].active) {
+            animations[i].active = false;
+            --nRunning;
+        }
+#ifdef HEADLESS
+        displayFlush();
+#endif
+        return;
+    }
+
+    if (!animations[i].active) ++nRunning;
+    animations[i] = anim;
+    drawAnimation(&animations[i]);
+}
+
+BOOL isAnimating(int slot) {
+
+    int i;
+
+    for (i=0; i<kMAX_ANIMATIONS; ++i) {
+        if (animations[i].active && animations[i].slot == slot) return true;
+    }
+
+    return false;
+}
+
+BOOL animationsRunning() {
+    return nRunning > 0;
+}
+
+void endFrame() {
+
+    int i;
+
+    for (i=0; i<kMAX_ANIMATIONS && nRunning > 0; ++i) {
+
+        Animation *anim = &animations[i];
+        if (!anim->active) continue;
+
+        ++(anim->frame);
+        drawAnimation(anim);
+
+        if (anim->frame >= anim->nFrames) {
+            anim->active = false;
+            --nRunning;
+        }
+    }
+
+    displayFlush();
+
+#ifndef HEADLESS
+    XTime now;
+    const XTime period = (XTime)kFRAME_US*COUNTS_PER_SECOND/1000000;
+
+    XTime_GetTime(&now);
+
+    // Late by more than a frame, e.g. after a search: starts over from now
+    if (nextFrame == 0 || now > nextFrame +period) nextFrame = now;
+    else if (now < nextFrame) halSleepMicros((uint32_t)((nextFrame -now)*1000000 /COUNTS_PER_SECOND));
+
+    nextFrame += period;
+#endif
+}
+
+void finishAnimations() {
+    while (nRunning > 0) endFrame();
+}
+
+void cancelAnimations() {
+
+    int i;
+
+    for (i=0; i<kMAX_ANIMATIONS; ++i) animations[i].active = false;
+    nRunning = 0;
+}
+
+// The curves tabulated by animationInit(), for progress in [0, 1]
+static float factorForAnimation(AnimationType animType, float progress) {
+    if (animType == AnimationTypeLin) {
+        return progress;
+    } else if (animType == AnimationTypeLog) {
+        return log(progress*9 +1);
+    } else if (animType == AnimationTypeArctan) {
+        return atan(progress*57) *0.6366197724;
+    } else if (animType == AnimationTypeCosh) {
+        return (cosh(progress*3)-1)/0.543;
+    } else if (animType == AnimationTypeQuad) {
+        return progress*progress;
+    } else if (animType == AnimationTypeSin) {
+        return sin(progress*1.5707963268);
+    } else if (animType == AnimationTypeGravity) {
+        return 4.9 *pow(0.45175*progress,2);
+    }
+    return 0;
+}
+
+static void drawAnimation(Animation *anim) {
+
+    int32_t progress = (int32_t)(((int64_t)anim->frame*kEASING_ONE) /anim->nFrames);
+    int32_t factor = easingFactor(anim->type, progress);
+    int dx = ((int64_t)(anim->to.x -anim->from.x)*factor) /kEASING_ONE;
+    int dy = ((int64_t)(anim->to.y -anim->from.y)*factor) /kEASING_ONE;
+
+    displaySet(anim->slot, encodeShape(anim->from.x +dx, anim->from.y +dy, anim->color, anim->shape));
+}
@@ -0,0 +1,38 @@
+#ifndef ANIMATION
+#define ANIMATION
+
+#include "Constants.h"
+
+// Shapes moving on the display list, any number of them at a time, each
+// advanced one frame by endFrame(). Nothing waits for an animation to end:
+// the game goes on between frames, calling endFrame() once per frame.
+// HEADLESS builds draw every animation at its end right away.
+
+#define kMAX_ANIMATIONS     8
+#define kEASING_ONE         65536   // 1.0 in the fixed point of easingFactor()
+
+// Builds the easing and falling tables, before the first animation
+void animationInit();
+
+// Fixed-point factorForAnimation(): progress and result are kEASING_ONE for 1.0
+int32_t easingFactor(AnimationType animType, int32_t progress);
+
+// Moves shape in slot from "from" to "to" in duration_s seconds, replacing
+// any animation of that slot. AnimationTypeGravity takes the time of a fall.
+void animateShape(uint8_t color, uint8_t shape, int slot, Point from, Point to, AnimationType animType, float duration_s);
+
+BOOL isAnimating(int slot);
+BOOL animationsRunning();
+
+// Advances the animations, flushes the display list and waits for the next
+// frame. Frames are kept on a fixed 60 Hz schedule: time spent between calls
+// is taken out of the wait, and frames missed altogether are dropped.
+void endFrame();
+
+// Runs frames until every animation is over
+void finishAnimations();
+
+// Leaves the shapes where they are
+void cancelAnimations();
+
+#endif
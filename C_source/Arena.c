@@ -0,0 +1,36 @@
+#include "Arena.h"
+
+// Aligned by hand: memalign() and friends aren't in every libc.
+BOOL arenaInit(Arena *arena, size_t bytes) {
+
+    arena->base = (uint8_t *) malloc(bytes +kARENA_ALIGNMENT);
+    arena->size = 0;
+    arena->used = 0;
+
+    if (arena->base == NULL) return false;
+
+    arena->size = bytes;
+    arena->used = arenaFootprint((uintptr_t)arena->base) -(uintptr_t)arena->base;
+    arena->size += arena->used;
+
+    return true;
+}
+
+void arenaFree(Arena *arena) {
+    if (arena->base != NULL) free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+void* arenaAlloc(Arena *arena, size_t bytes) {
+
+    size_t footprint = arenaFootprint(bytes);
+
+    if (arena->base == NULL || footprint > arena->size -arena->used) return NULL;
+
+    void *memory = arena->base +arena->used;
+    arena->used += footprint;
+
+    return memory;
+}
@@ -0,0 +1,26 @@
+#ifndef ARENA
+#define ARENA
+
+#include "Constants.h"
+
+// One block of memory, handed out front to back and given back all at once.
+// Whatever lives for the whole program comes from here, so that nothing
+// needs the heap once it's set up.
+
+#define kARENA_ALIGNMENT    64      // A cache line
+
+typedef struct {
+    uint8_t *base;
+    size_t size, used;
+} Arena;
+
+BOOL arenaInit(Arena *arena, size_t bytes);
+void arenaFree(Arena *arena);
+
+// NULL once the arena is full
+void* arenaAlloc(Arena *arena, size_t bytes);
+
+// Bytes arenaAlloc() takes for a request of bytes
+#define arenaFootprint(_bytes) (((_bytes) +kARENA_ALIGNMENT -1) & ~(size_t)(kARENA_ALIGNMENT -1))
+
+#endif
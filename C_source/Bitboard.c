@@ -0,0 +1,58 @@
+#include "Bitboard.h"
+
+uint64_t zobristKeys[2][kBB_CELLS];
+uint64_t zobristSideKeys[2];
+
+// Fills the key table with a fixed xorshift sequence, so keys are the same on every run.
+void initZobristKeys() {
+    static BOOL ready = false;
+    if (ready) return;
+
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    int t, c;
+
+    for (t=0; t<2; ++t) {
+        for (c=0; c<kBB_CELLS; ++c) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            zobristKeys[t][c] = x;
+        }
+    }
+
+    for (t=0; t<2; ++t) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        zobristSideKeys[t] = x;
+    }
+
+    ready = true;
+}
+
+void positionFromBoard(Position *pos, const Board *board, const char players[]) {
+
+    int i, j;
+
+    initZobristKeys();
+
+    pos->discs[0] = 0;
+    pos->discs[1] = 0;
+    pos->nMoves = 0;
+    pos->key = 0;
+
+    for (j=0; j<kBOARDS_COLS; ++j) {
+
+        pos->heights[j] = 0;
+
+        // From the bottom row up, the matrix stores the top row at index 0
+        for (i=kBOARDS_ROWS -1; i>=0; --i) {
+
+            char player = board->matrix[i][j];
+            if (player == kEMPTY) break;
+
+            int who = (player == players[0] ? 0 : 1);
+            positionPlay(pos, j, who);
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef BITBOARD
+#define BITBOARD
+
+#include "Constants.h"
+
+// Each column takes kBB_HEIGHT bits: kBOARDS_ROWS playable cells plus one
+// always-empty sentinel bit on top, so that horizontal and diagonal shifts
+// never carry a line over from one column into the next.
+//
+//   6 13 20 27 34 41 48   <- sentinel row
+//   5 12 19 26 33 40 47
+//   4 11 18 25 32 39 46
+//   3 10 17 24 31 38 45
+//   2  9 16 23 30 37 44
+//   1  8 15 22 29 36 43
+//   0  7 14 21 28 35 42   <- bottom row
+
+#define kBB_HEIGHT          (kBOARDS_ROWS +1)
+#define kBB_CELLS           (kBOARDS_COLS *kBB_HEIGHT)
+
+#if kBB_CELLS <= 64
+typedef uint64_t Bitboard;
+#elif kBB_CELLS <= 128
+// 9x7 and up. GCC and Clang have 128-bit integers on 64-bit targets.
+typedef unsigned __int128 Bitboard;
+#else
+#error "Boards with more than 128 cells (sentinels included) aren't supported"
+#endif
+
+typedef struct {
+    Bitboard discs[2];              // discs[t] belongs to players[t]
+    uint8_t heights[kBOARDS_COLS];  // discs already in each column
+    int nMoves;
+    uint64_t key;                   // Zobrist hash, updated incrementally
+} Position;
+
+// Every bit of the board with the sentinels, the bottom cell of each column,
+// and every cell that can hold a disc
+#define kBB_ALL_BITS        (~(Bitboard)0 >> (8*sizeof(Bitboard) -kBB_CELLS))
+#define kBB_BOTTOM          (kBB_ALL_BITS /((((Bitboard)1) << kBB_HEIGHT) -1))
+#define kBB_BOARD           (kBB_BOTTOM *((((Bitboard)1) << kBOARDS_ROWS) -1))
+
+#define cellIndex(_col,_rowFromBottom) ((_col)*kBB_HEIGHT + (_rowFromBottom))
+#define bitForCell(_col,_rowFromBottom) (((Bitboard)1) << cellIndex(_col,_rowFromBottom))
+
+extern uint64_t zobristKeys[2][kBB_CELLS];
+extern uint64_t zobristSideKeys[2];
+
+// Key that also tells who is to move, for results that depend on it
+#define keyWithSideToMove(_pos,_who) ((_pos)->key ^ zobristSideKeys[_who])
+
+void initZobristKeys();
+void positionFromBoard(Position *pos, const Board *board, const char players[]);
+
+static inline BOOL positionCanPlay(const Position *pos, int col) {
+    return pos->heights[col] < kBOARDS_ROWS;
+}
+
+// Drops a disc of players[who] in col. Returns the row (counted from the bottom).
+static inline int positionPlay(Position *pos, int col, int who) {
+    int row = pos->heights[col]++;
+    pos->discs[who] |= bitForCell(col, row);
+    pos->key ^= zobristKeys[who][cellIndex(col, row)];
+    ++(pos->nMoves);
+    return row;
+}
+
+static inline void positionUndo(Position *pos, int col, int who) {
+    int row = --(pos->heights[col]);
+    pos->discs[who] &= ~bitForCell(col, row);
+    pos->key ^= zobristKeys[who][cellIndex(col, row)];
+    --(pos->nMoves);
+}
+
+static inline Bitboard positionOccupied(const Position *pos) {
+    return pos->discs[0] | pos->discs[1];
+}
+
+// TRUE if the mask contains kLEN_TO_WIN aligned discs in any direction.
+static inline BOOL bitboardHasAlignment(Bitboard b) {
+
+    // Vertical, horizontal, and the two diagonals
+    const int dirs[4] = {1, kBB_HEIGHT, kBB_HEIGHT -1, kBB_HEIGHT +1};
+    int k, s;
+
+    for (k=0; k<4; ++k) {
+        Bitboard m = b;
+        for (s=1; s<kLEN_TO_WIN; ++s) {
+            m &= b >> (s*dirs[k]);
+        }
+        if (m) return true;
+    }
+
+    return false;
+}
+
+// Cells that would complete a line of the discs in b, empty or not. One pass
+// over the whole board instead of one check per column.
+static inline Bitboard bitboardWinningCells(Bitboard b) {
+
+    const int dirs[4] = {1, kBB_HEIGHT, kBB_HEIGHT -1, kBB_HEIGHT +1};
+    Bitboard cells = 0;
+    int k, gap, s;
+
+    for (k=0; k<4; ++k) {
+        // The missing cell at each place along the line
+        for (gap=0; gap<kLEN_TO_WIN; ++gap) {
+            Bitboard m = kBB_BOARD;
+            for (s=0; s<kLEN_TO_WIN; ++s) {
+                int shift = (s -gap)*dirs[k];
+                if (shift > 0) m &= b >> shift;
+                else if (shift < 0) m &= b << -shift;
+            }
+            cells |= m;
+        }
+    }
+
+    return cells;
+}
+
+// The cell a disc would land in, for every column that isn't full
+static inline Bitboard positionPlayableCells(const Position *pos) {
+    return (positionOccupied(pos) +kBB_BOTTOM) & kBB_BOARD;
+}
+
+static inline BOOL positionIsWinningMove(const Position *pos, int col, int who) {
+    return bitboardHasAlignment(pos->discs[who] | bitForCell(col, pos->heights[col]));
+}
+
+#endif
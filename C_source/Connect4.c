@@ -1,34 +1,51 @@
 #include "AI.h"
+#include "Animation.h"
 #include "Constants.h"
 #include "Drawer.h"
+#include "GameRecord.h"
+#include "Input.h"
+#include "Random.h"
+#include "WinTracker.h"
 #include "math.h"
+#include <string.h>
 
 ////////////////////////////////////////////////
 
-static XGpio input, output;
-static uint32_t *balls = kPOINTERBRAM;
-static uint32_t *grid_on = kPOINTERBRAM;
+static int firstBallSlot;   // The n-th disc of a game is drawn in slot firstBallSlot +n -1
 static int maxDemoMatches;
+static Board theBoard;      // One game at a time, nothing allocated per game
+static RecordWriter *recorder;  // Every game goes to it, if set
+static Random gameSeeds;        // Draws the seed of every game
+
+// Carried from one game of a session to the next
+static Statistics stats;
+static BOOL isDemo = false;
+static int numberOfDemoMatches = 0;
 
 ///////////////////// INTERFACE /////////////////////
 
-void init_gpio();
-Board* newBoard();
-Board* freeBoard(Board *board);
+Board* resetBoard();
 Statistics init_stats();
+void recordDemoResult(Statistics *stats, int winner);
 
-char winningPlayer(Board *board);
+void playSession();
 int newGame(Board *board, GameMode gameMode, Statistics *stats);
 
 void animateLEDs();
-void gameOverAnimation(uint8_t m[2][4], int winner, BOOL isDemo, int matchNumber);
+void gameOverAnimation(uint8_t m[2][kLEN_TO_WIN], int winner, BOOL isDemo, int matchNumber);
 void waitTilReset();
 void displayStatistics(Statistics stats);
+void waitForButton();
 
 uint64_t randFromClock();
+int depthForCPU(char cpu);
+uint16_t recordedSetting(char player);
+uint8_t percent(double value);
+void playAnimationsOut();
 GameMode askForGameMode();
 
 void demoWelcomeScreen();
+void attachPreloadedTables();
 
 /////////////////////////////////////////////////////
 
@@ -37,107 +54,256 @@ void demoWelcomeScreen();
 
 /////////////////////// MAIN ////////////////////////
 
+#ifndef HEADLESS
+
 int main() {
     
-    init_gpio();
-    init_platform();
-    Statistics stats = init_stats();
-    BOOL isDemo = false;
-    int numberOfDemoMatches = 0;
+    halInit();
+    displayInit();
+    animationInit();
+    inputInit();
+    CPUsReserve();
+    attachPreloadedTables();
+    randomSeed(&gameSeeds, randFromClock());
+    stats = init_stats();
     maxDemoMatches = 10;
 
     // Initial animation.
     animateLEDs();
     
     while (1) {
+        playSession();
+    }
+    
+    halCleanup();
+    return 0;
+}
 
-        DEBOUNCE;
-        
-        // Removes everything from the screen.
-        clearBram();
-        
-        // Allocates and inits a new board.
-        Board *board = newBoard();
-        
-        GameMode mode = GameModeInvalid;
+// The opening book and the endgame table, if the debugger loaded them (see
+// HAL.h). The EXPERT's search stops at the positions of the table.
+void attachPreloadedTables() {
+    static OpeningBook book;
+    static EndgameTable endgame;
+    if (bookAttach(&book, (const void *)kHAL_BOOK_ADDRESS, kHAL_PRELOAD_BYTES)) {
+        xil_printf("Opening book of %u positions\n", (unsigned)book.header->count);
+        setCPUsOpeningBook(&book);
+    }
+    if (endgameAttach(&endgame, (const void *)kHAL_ENDGAME_ADDRESS, kHAL_PRELOAD_BYTES)) {
+        xil_printf("Endgame table of %u positions\n", (unsigned)endgame.header->count);
+        setCPUsEndgameTable(&endgame);
+    }
+}
 
-        if (isDemo) {
-            mode = GameModeDemo;
+#else
+
+// Plays demo matches back-to-back with no animations and no pauses, then
+// prints the statistics. Usage: connect4_headless [-s seed] [-r shapes] [-g games] [-i script] [-b book] [-x endgame] [matches] [json|csv]
+// The second argument adds the search statistics (needs USE_SEARCH_STATS).
+// -r records every frame's shape list for Host_tools/Render, -g appends
+// every game to a record file (see GameRecord.h). The same seed plays the
+// same games; without -s, it comes from the clock and is printed.
+// -i plays the board's sessions instead, menus included, with the buttons
+// and switches of a script (see halScriptInput()), then prints how long
+// the inputs took to show on the display. -b gives the CPUs an opening book
+// (see Host_tools/BookGenerator.c), -x the EXPERT an endgame table (see
+// Host_tools/EndgameGenerator.c).
+int main(int argc, char *argv[]) {
+
+    halInit();
+
+    FILE *recording = NULL, *games = NULL, *script = NULL;
+    const char *bookPath = NULL, *endgamePath = NULL;
+    RecordWriter writer;
+    uint64_t seed = randFromClock();
+
+    while (argc > 2 && (strcmp(argv[1], "-r") == 0 || strcmp(argv[1], "-g") == 0 || strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "-i") == 0
+                         || strcmp(argv[1], "-b") == 0 || strcmp(argv[1], "-x") == 0)) {
+        if (strcmp(argv[1], "-s") == 0) {
+            seed = strtoull(argv[2], NULL, 10);
+        } else if (strcmp(argv[1], "-b") == 0) {
+            bookPath = argv[2];
+        } else if (strcmp(argv[1], "-x") == 0) {
+            endgamePath = argv[2];
+        } else if (strcmp(argv[1], "-i") == 0) {
+            script = fopen(argv[2], "r");
+            if (script == NULL || !halScriptInput(script)) {
+                fprintf(stderr, "%s: not an input script\n", argv[2]);
+                return 1;
+            }
+        } else if (strcmp(argv[1], "-r") == 0) {
+            recording = fopen(argv[2], "wb");
+            if (recording == NULL) {
+                perror(argv[2]);
+                return 1;
+            }
+            halRecordShapes(recording);
         } else {
-            mode = askForGameMode();
-            if (mode == GameModeDemo) {
-                isDemo = true;
-                numberOfDemoMatches = 0;
-                demoWelcomeScreen();
+            games = fopen(argv[2], "a+b");
+            if (games == NULL || !recordWriterInit(&writer, games)) {
+                fprintf(stderr, "%s: can't append games to it\n", argv[2]);
+                return 1;
             }
+            recorder = &writer;
         }
+        argc -= 2;
+        argv += 2;
+    }
 
-        // Takes care of the current match and returns the winner.
-        int winner = newGame(board, mode, &stats);
+#ifdef USE_MMAP
+    static OpeningBook book;
 
-        // Checks if there's a winner, else a reset has been requested
-        if (winner != 0) {
-            
-            // Animates the board and highlights the winning cells.
-            gameOverAnimation(board->winningCells, winner, isDemo, ++numberOfDemoMatches);
+    if (bookPath != NULL) {
+        if (!bookOpen(&book, bookPath)) {
+            fprintf(stderr, "%s: not an opening book of %dx%d, %d to win\n", bookPath, kBOARDS_COLS, kBOARDS_ROWS, kLEN_TO_WIN);
+            return 1;
+        }
+        setCPUsOpeningBook(&book);
+    }
 
-            // Different behavior in case of demo mode
-            if (isDemo) { 
+    static EndgameTable endgame;
 
-                if (winner == kCPU_HARD) {
-                    stats.victoriesCPU1 += 1;
-                } else if (winner == kCPU_EASY) {
-                    stats.victoriesCPU2 += 1;
-                } else {
-                    stats.ties += 1;
-                }
+    if (endgamePath != NULL) {
+        if (!endgameOpen(&endgame, endgamePath)) {
+            fprintf(stderr, "%s: not an endgame table of %dx%d, %d to win\n", endgamePath, kBOARDS_COLS, kBOARDS_ROWS, kLEN_TO_WIN);
+            return 1;
+        }
+        setCPUsEndgameTable(&endgame);
+    }
+#else
+    if (bookPath != NULL || endgamePath != NULL) {
+        fprintf(stderr, "books and endgame tables need a build with USE_MMAP\n");
+        return 1;
+    }
+#endif
 
-                int numOfMatches = stats.victoriesCPU1 + stats.victoriesCPU2 + stats.ties;
+    displayInit();
+    animationInit();
+    inputInit();
+    CPUsReserve();
+    randomSeed(&gameSeeds, seed);
+    stats = init_stats();
+    maxDemoMatches = (argc > 1 ? atoi(argv[1]) : 100);
 
-                // If we've reached the last demo match, we stop and display the results
-                if (numOfMatches >= maxDemoMatches) {
+    XTime tStart, tEnd;
+    XTime_GetTime(&tStart);
 
-                	displayStatistics(stats);
+    if (script != NULL) {
 
-                	stats = init_stats();
-                    isDemo = false;
-                    numberOfDemoMatches = 0;
-                }
+        while (!inputOver()) playSession();
 
-            } else {
+        const InputLatency *latency = inputLatency();
+        printf("inputs shown %lu, latency mean %.3f ms, max %.3f ms, dropped %lu\n", (unsigned long)latency->count,
+               (latency->count > 0 ? latency->total_us /1000.0 /latency->count : 0), latency->max_us /1000.0, (unsigned long)latency->dropped);
 
-                // Asks the user to press a button to continue
-                waitTilReset();
-            }
+        fclose(script);
+
+    } else {
+
+        int i;
+        for (i=0; i<maxDemoMatches; ++i) {
+
+            Board *board = resetBoard();
+
+            displayClear();
+
+            recordDemoResult(&stats, newGame(board, GameModeDemo, &stats));
         }
-        
-        // Deallocates the board and returns NULL
-        board = freeBoard(board);
+
+        XTime_GetTime(&tEnd);
+
+        double seconds = (double)(tEnd - tStart) /COUNTS_PER_SECOND;
+
+        printf("seed %llu, matches %d\n", (unsigned long long)seed, maxDemoMatches);
+        printf("victories CPU HARD %lu, CPU EASY %lu, ties %lu\n", (unsigned long)stats.victoriesCPU1, (unsigned long)stats.victoriesCPU2, (unsigned long)stats.ties);
+        printf("time CPU HARD %.1f ms, CPU EASY %.1f ms\n", stats.timeOfCPU1/10.0, stats.timeOfCPU2/10.0);
+        printf("wall %.3f s, %.1f matches/min\n", seconds, (seconds > 0 ? maxDemoMatches*60.0/seconds : 0));
+        printf("shape words written %lu\n", (unsigned long)displayWordsFlushed());
+
+#ifdef USE_SEARCH_STATS
+        if (argc > 2) printCPUsSearchStats(strcmp(argv[2], "csv") != 0);
+#endif
     }
-    
-    cleanup_platform();
+
+    if (recording != NULL) fclose(recording);
+    if (games != NULL) fclose(games);
+
+    halCleanup();
     return 0;
 }
 
-/////////////////////////////////////////////////////
+#endif
 
+// The menu, then one game, as the board plays them over and over
+void playSession() {
 
+    // Removes everything from the screen.
+    displayClear();
+    
+    // Empties the board.
+    Board *board = resetBoard();
+    
+    GameMode mode = GameModeInvalid;
 
+    if (isDemo) {
+        mode = GameModeDemo;
+    } else {
+        mode = askForGameMode();
+        if (mode == GameModeDemo) {
+            isDemo = true;
+            numberOfDemoMatches = 0;
+            demoWelcomeScreen();
+        }
+    }
 
-////////////// MEM. MANAGEMENT & INITS //////////////
+    // Takes care of the current match and returns the winner.
+    int winner = newGame(board, mode, &stats);
+
+    // Checks if there's a winner, else a reset has been requested
+    if (winner != 0) {
+        
+        // Animates the board and highlights the winning cells.
+        gameOverAnimation(board->winningCells, winner, isDemo, ++numberOfDemoMatches);
+
+        // Different behavior in case of demo mode
+        if (isDemo) { 
+
+            recordDemoResult(&stats, winner);
+
+            int numOfMatches = stats.victoriesCPU1 + stats.victoriesCPU2 + stats.ties;
+
+            // If we've reached the last demo match, we stop and display the results
+            if (numOfMatches >= maxDemoMatches) {
+
+            	displayStatistics(stats);
+
+#ifdef USE_SEARCH_STATS
+                printCPUsSearchStats(true);
+                resetCPUsSearchStats();
+#endif
+
+            	stats = init_stats();
+                isDemo = false;
+                numberOfDemoMatches = 0;
+            }
+
+        } else {
 
-void init_gpio() {
-    XGpio_Initialize(&input, XPAR_AXI_GPIO_0_DEVICE_ID);
-    XGpio_Initialize(&output, XPAR_AXI_GPIO_1_DEVICE_ID);
-    XGpio_SetDataDirection(&input, 1, 0xF);
-    XGpio_SetDataDirection(&input, 2, 0xF);
-    XGpio_SetDataDirection(&output, 1, 0x0);
+            // Asks the user to press a button to continue
+            waitTilReset();
+        }
+    }
 }
 
-Board* newBoard() {
+/////////////////////////////////////////////////////
+
+
+
+
+////////////// MEM. MANAGEMENT & INITS //////////////
+
+Board* resetBoard() {
     
-    Board *board = (Board *) malloc(sizeof(Board));
-    if (board == NULL) return NULL;
+    Board *board = &theBoard;
     
     board->n_balls = 0;
     board->emptyCells = kBOARDS_COLS * kBOARDS_ROWS;
@@ -151,7 +317,7 @@ Board* newBoard() {
     }
     
     for(i=0;i<2;++i){
-        for(j=0;j<4;++j){
+        for(j=0;j<kLEN_TO_WIN;++j){
             board->winningCells[i][j] = 0;
         }
     }
@@ -159,11 +325,6 @@ Board* newBoard() {
     return board;
 }
 
-Board* freeBoard(Board *board) {
-    if (board != NULL) free(board);
-    return NULL;
-}
-
 Statistics init_stats() {
 	Statistics stats;
 	stats.timeOfCPU1 = 0;
@@ -171,9 +332,21 @@ Statistics init_stats() {
 	stats.victoriesCPU1 = 0;
 	stats.victoriesCPU2 = 0;
 	stats.ties = 0;
+	stats.depthOfCPU1 = 0;
+	stats.depthOfCPU2 = 0;
 	return stats;
 }
 
+void recordDemoResult(Statistics *stats, int winner) {
+    if (winner == kCPU_HARD) {
+        stats->victoriesCPU1 += 1;
+    } else if (winner == kCPU_EASY) {
+        stats->victoriesCPU2 += 1;
+    } else {
+        stats->ties += 1;
+    }
+}
+
 /////////////////////////////////////////////////////
 
 
@@ -191,55 +364,6 @@ Point makePointOnGrid(int theCol, int theRow) {
     return pt;
 }
 
-float factorForAnimation(AnimationType animType, float progress) {
-    if (animType == AnimationTypeLin) {
-        return progress;
-    } else if (animType == AnimationTypeLog) {
-        return sign(progress) *log(fabs(progress)*9 +1);
-    } else if (animType == AnimationTypeArctan) {
-        return atan(progress*57) *0.6366197724;
-    } else if (animType == AnimationTypeCosh) {
-        return (cosh(progress*3)-1)/0.543;
-    } else if (animType == AnimationTypeQuad) {
-        return sign(progress) *progress*progress;
-    } else if (animType == AnimationTypeSin) {
-        return sin(progress*1.5707963268);
-    } else if (animType == AnimationTypeGravity) {
-        return sign(progress) *4.9 *pow(0.45175*progress,2);
-    }
-    return 0;
-}
-
-void async_animateShape(uint8_t color, uint8_t shape, uint32_t *pp, Point from, Point to, AnimationType animType, float progress) {
-    
-    float factor = factorForAnimation(animType,progress);
-    int dx = (to.x - from.x) *factor;
-    int dy = (to.y - from.y) *factor;
-    
-    *pp = encodeShape(from.x+dx,from.y+dy,color,shape);
-}
-
-float durationOfFall(Point from, Point to) {
-
-	double metersPerPixel = 0.0005703125;
-
-	double dy = abs(to.y -from.y) *metersPerPixel;
-
-	return (float)pow((2*dy)/9.8, 0.5);
-}
-
-void sync_animateShape(uint8_t color, uint8_t shape, uint32_t *pp, Point from, Point to, AnimationType animType, float duration_s) {
-    
-	if (animType == AnimationTypeGravity) duration_s = durationOfFall(from,to);
-
-    uint32_t nframes = duration_s * 60;
-    int i;
-    for (i = 0; i <= nframes; ++i) {
-        async_animateShape(color,shape,pp,from,to,animType,(float)i/nframes);
-        if (i<nframes) usleep(1/60.0 *1000000);
-    }
-}
-
 /////////////////////////////////////////////////////
 
 
@@ -247,9 +371,10 @@ void sync_animateShape(uint8_t color, uint8_t shape, uint32_t *pp, Point from, P
 
 ///////////////////// GAME CTRL /////////////////////
 
-BOOL insertInColumnAtIndex(int indx, char player, Board *board, uint16_t ypos) {
+// Returns the row the disc lands in (0 is the top one), -1 if it can't be inserted.
+int insertInColumnAtIndex(int indx, char player, Board *board, uint16_t ypos) {
     if (indx < 0|| indx >= kBOARDS_COLS || board->matrix[0][indx] != kEMPTY) {
-        return false;
+        return -1;
     }
     int i;
     for (i = kBOARDS_ROWS -1; i>=0; --i) {
@@ -270,81 +395,25 @@ BOOL insertInColumnAtIndex(int indx, char player, Board *board, uint16_t ypos) {
 				case kCPU_EASY:
 					color = kCPU_EASY_COL;
 					break;
+				case kCPU_EXPERT:
+					color = kCPU_EXPERT_COL;
+					break;
 			}
 
-            sync_animateShape(color, kBALL_SHAPE, &balls[board->n_balls], makePoint(xForColumn(indx),ypos), makePointOnGrid(indx, i), AnimationTypeGravity, 0.1835);
+            animateShape(color, kBALL_SHAPE, firstBallSlot +board->n_balls -1, makePoint(xForColumn(indx),ypos), makePointOnGrid(indx, i), AnimationTypeGravity, 0.1835);
 
             board->matrix[i][indx] = player;
             --(board->emptyCells);
-            return true;
-        }
-    }
-    return false;
-}
-
-char winningPlayer(Board *board) {
-	int winner=kEMPTY;
-    int offset[2][8] = {{0, 0, 1, 1, 1,-1,-1,-1},
-                        {1,-1, 1, 0,-1, 1, 0,-1}};
-    int i,j,k,s;
-
-    // For each row
-    for (i=0; i<kBOARDS_ROWS; ++i) {
-
-        // For each column
-        for (j=0; j<kBOARDS_COLS; ++j) {
-
-            // The player in the current position
-            char player = board->matrix[i][j];
-            if (player == kEMPTY) continue;
-
-        	board->winningCells[0][0]=(uint8_t)j;
-        	board->winningCells[1][0]=(uint8_t)i;
-
-            // For each possible direction
-            for (k=0; k<8; ++k) {
-                int i_off = offset[0][k];
-                int j_off = offset[1][k];
-
-                BOOL validWin = true;
-
-                // For each step in the same direction
-                for (s=1; s<kLEN_TO_WIN; ++s) {
-
-                    int i_cur = i +i_off*s;
-                    int j_cur = j +j_off*s;
-
-                	board->winningCells[0][s]=(uint8_t)j_cur;
-                	board->winningCells[1][s]=(uint8_t)i_cur;
-
-                    // Invalid position. Useless to continue.
-                    if (i_cur < 0 || j_cur < 0 || i_cur >= kBOARDS_ROWS || j_cur >= kBOARDS_COLS) {
-                        validWin = false;
-                        break;
-                    }
-                    // No win. Break.
-                    if (board->matrix[i_cur][j_cur] != player) {
-                        validWin = false;
-                        break;
-                    }
-                }
-
-                if (validWin) {
-                	winner=player;
-                	return winner;
-                }
-            }
-
+            return i;
         }
     }
-
-    return winner;
+    return -1;
 }
 
 int newGame(Board *board, GameMode gameMode, Statistics *stats) {
     
-    DEBOUNCE;
-    clearBram();
+    inputFlush();
+    displayClear();
 
     char players[2];
     BOOL isDemo = false;
@@ -362,6 +431,10 @@ int newGame(Board *board, GameMode gameMode, Statistics *stats) {
             players[0]=kPLAYER_1;
             players[1]=kCPU_EASY;
             break;
+        case GameModePlayerVsCPUExpert:
+            players[0]=kPLAYER_1;
+            players[1]=kCPU_EXPERT;
+            break;
         case GameModeDemo:
             players[0]=kCPU_HARD;
             players[1]=kCPU_EASY;
@@ -372,19 +445,36 @@ int newGame(Board *board, GameMode gameMode, Statistics *stats) {
     }
 
 
-    uint32_t *pp = kPOINTERBRAM;
+    // Who moves first and the demo mistakes, all from the game's seed
+    uint64_t seed = randomNext(&gameSeeds);
+    int turn = seed%2;
+    setCPUsSeed(seed);
 
-    int turn = randFromClock()%2;
+    if (recorder != NULL) {
+        uint16_t settings[2] = {recordedSetting(players[0]), recordedSetting(players[1])};
+        uint16_t mistakes[2] = {(isDemo ? kERROR_FACTOR : 0), (isDemo ? kERROR_FACTOR : 0)};
+        recordBegin(recorder, players, settings, mistakes, seed, turn);
+    }
     
-    grid_on[0] = 1;
+    // Only the lines through each new disc are checked for a win
+    WinTracker tracker;
+    winTrackerReset(&tracker);
+
+    displaySetGrid(true);
+
+    int speakerSlot = displayAlloc(labelSlots("* speaks"));
+    firstBallSlot = displayAlloc(kBOARDS_CELLS);
     
 
     while (1) {
 
-        DEBOUNCE;
+        // A turn starts from what's pressed in it
+        inputFlush();
         
         // Check if it's a tie
         if (board->emptyCells <= 0) {
+            finishAnimations();
+            if (recorder != NULL) recordEnd(recorder, RecordResultTie);
             return kEMPTY;
         }
         
@@ -396,7 +486,14 @@ int newGame(Board *board, GameMode gameMode, Statistics *stats) {
 
         uint8_t color = colorForPlayer(players[turn]);
 
-        drawLabel(560, 200,"* speaks", color, &pp[43]);
+        drawLabel(560, 200,"* speaks", color, speakerSlot);
+        displayFlush();
+
+        // The last disc lands before a CPU takes its turn
+        if (players[turn] != kPLAYER_1 && players[turn] != kPLAYER_2) playAnimationsOut();
+
+        XTime tThink, tChosen;
+        XTime_GetTime(&tThink);
         
         if (players[turn] == kCPU_HARD) {
 
@@ -411,6 +508,7 @@ int newGame(Board *board, GameMode gameMode, Statistics *stats) {
             uint32_t tTot = (tEnd - tStart)*10000 /COUNTS_PER_SECOND;
 
             stats->timeOfCPU1 += tTot;
+            stats->depthOfCPU1 = kCPU_HARD_MAX_DEPTH;
             
         } else if (players[turn] == kCPU_EASY) {
 
@@ -425,53 +523,90 @@ int newGame(Board *board, GameMode gameMode, Statistics *stats) {
             uint32_t tTot = (tEnd - tStart)*10000 /COUNTS_PER_SECOND;
 
             stats->timeOfCPU2 += tTot;
+            stats->depthOfCPU2 = kCPU_EASY_MAX_DEPTH;
             
+        } else if (players[turn] == kCPU_EXPERT) {
+
+            XTime tStart, tEnd;
+            SearchReport report;
+
+            XTime_GetTime(&tStart);
+
+            // Bounded latency: whatever depth fits in the time budget
+            choice = CPUsChoiceWithinTime(board, players, turn, kCPU_EXPERT_TIME_MS, isDemo, &report);
+
+            XTime_GetTime(&tEnd);
+
+            uint32_t tTot = (tEnd - tStart)*10000 /COUNTS_PER_SECOND;
+
+            // The strongest CPU is accounted as CPU 1
+            stats->timeOfCPU1 += tTot;
+            if (report.depthReached > stats->depthOfCPU1) stats->depthOfCPU1 = report.depthReached;
+
         } else {
             
-            for (choice=3; !canInsertInColumnAtIndex(choice,board); choice=(choice+1)%7);
-            
-            char button_data = -1;
+            for (choice=kBOARDS_COLS/2; !canInsertInColumnAtIndex(choice,board); choice=(choice+1)%kBOARDS_COLS);
             
-            int current_selection = -1;
-            int current_selection_count = 0;
+            BOOL chosen = false;
+            uint32_t pressed = 0;           // Since the turn started
             
-            uint32_t *curBall = &balls[board->n_balls];
+            int curBall = firstBallSlot +board->n_balls -1;
             
             float animDur_s = .3;
-            float animProg = 0;
+            int32_t animStep = kEASING_ONE /(60.0 *animDur_s);
+            int32_t animProg = 0;
             int animDir = 1;
+
+            // The CPU searches its answers in the spare time of every frame
+            char opponent = players[(turn +1)%2];
+            if (opponent == kCPU_HARD || opponent == kCPU_EASY || opponent == kCPU_EXPERT) {
+                CPUsPonderStart(board, players, turn, depthForCPU(opponent));
+            }
             
             // USER CHOICE
-            while ((button_data != BUTTON_1) && (button_data != BUTTON_2)) {
+            while (!chosen) {
                 
-                button_data = XGpio_DiscreteRead(&input, 1);
+                InputEvent event;
+                int selection = -1;
+                BOOL reset = inputOver();
                 
-                if (button_data == BUTTON_1+BUTTON_2) return 0;
+                // The presses since the last frame, one move at a time. The
+                // disc drops when its button is released, so that the other
+                // one can still join it for a reset.
+                while (!chosen && !reset && selection == -1 && inputNext(&event)) {
+                    if ((event.buttons & (BUTTON_1+BUTTON_2)) == BUTTON_1+BUTTON_2) {
+                        reset = true;
+                    } else if (event.changed == BUTTON_1 || event.changed == BUTTON_2) {
+                        if (event.type == InputEventButtonDown) pressed |= event.changed;
+                        chosen = (event.type == InputEventButtonUp && (pressed & event.changed) && event.buttons == 0);
+                        if (chosen) inputHandled(&event);
+                    } else if (event.type == InputEventButtonDown && (event.changed == BUTTON_0 || event.changed == BUTTON_3)) {
+                        selection = event.changed;
+                        inputHandled(&event);
+                    }
+                }
                 
-                int selection = -1;
-                if (button_data != 0 && button_data == current_selection) {
-                    if (current_selection_count == 2) {
-                        selection = button_data;
-                    } ++current_selection_count;
-                } else {
-                    current_selection = button_data;
-                    current_selection_count = -1;
+                if (reset) {
+                    CPUsPonderStop();
+                    cancelAnimations();
+                    if (recorder != NULL) recordEnd(recorder, RecordResultAbandoned);
+                    return 0;
                 }
                 
                 // 10 is the "amplitude" of the displacement
-                currBallY = yForRow(-1) +10*factorForAnimation(AnimationTypeSin,animProg);
+                currBallY = yForRow(-1) +10*easingFactor(AnimationTypeSin,animProg)/kEASING_ONE;
                 
-                *curBall = encodeShape(xForColumn(choice), currBallY, color, kBALL_SHAPE);
+                if (!isAnimating(curBall)) displaySet(curBall, encodeShape(xForColumn(choice), currBallY, color, kBALL_SHAPE));
                 
                 if (selection == BUTTON_3) {
                     
                     // MOVE CHOICE TO LEFT
                     
                     int t;
-                    for (t = choice-1; 1; t = (t-1 >= 0 ? t-1 : 6)) {
+                    for (t = choice-1; 1; t = (t-1 >= 0 ? t-1 : kBOARDS_COLS-1)) {
                         if (canInsertInColumnAtIndex(t, board)) break;
                     }
-                    sync_animateShape(color, kBALL_SHAPE, curBall, makePoint(xForColumn(choice),currBallY), makePointOnGrid(t,-1), AnimationTypeLin, .3);
+                    animateShape(color, kBALL_SHAPE, curBall, makePoint(xForColumn(choice),currBallY), makePointOnGrid(t,-1), AnimationTypeLin, .3);
                     choice = t;
                     animDir = 1;
                     animProg = 0;
@@ -481,36 +616,49 @@ int newGame(Board *board, GameMode gameMode, Statistics *stats) {
                     // MOVE CHOICE TO RIGHT
                     
                     int t;
-                    for (t = (choice+1)%7; 1; t = (t+1)%7) {
+                    for (t = (choice+1)%kBOARDS_COLS; 1; t = (t+1)%kBOARDS_COLS) {
                         if (canInsertInColumnAtIndex(t, board)) break;
                     }
-                    sync_animateShape(color, kBALL_SHAPE, curBall, makePoint(xForColumn(choice),currBallY), makePointOnGrid(t,-1), AnimationTypeLin, .3);
+                    animateShape(color, kBALL_SHAPE, curBall, makePoint(xForColumn(choice),currBallY), makePointOnGrid(t,-1), AnimationTypeLin, .3);
                     choice = t;
                     animDir = 1;
                     animProg = 0;
                     
                 }
                 
-                float animStep = animDir *(1.0/(60.0 *animDur_s));
-                
-                if (animProg +animStep >= 1 || animProg +animStep <= -1) {
+                if (animProg +animDir*animStep >= kEASING_ONE || animProg +animDir*animStep <= -kEASING_ONE) {
                     animDir = -animDir;
-                    animStep = -animStep;
                 }
                 
-                animProg += animStep;
+                animProg += animDir*animStep;
                 
-                usleep(1/60.0 *1000000);
+                CPUsPonder(kPONDER_SLICE_US);
+                endFrame();
             }
         }
+
+        XTime_GetTime(&tChosen);
+        if (recorder != NULL) recordMove(recorder, choice, (uint32_t)((tChosen -tThink)*1000000 /COUNTS_PER_SECOND));
+
+        // The CPU to move next searches its answer while the disc falls
+        char next = players[(turn +1)%2];
+        if (next != kPLAYER_1 && next != kPLAYER_2) {
+#ifndef HEADLESS
+            if (players[turn] != kPLAYER_1 && players[turn] != kPLAYER_2) CPUsPonderStart(board, players, turn, depthForCPU(next));
+#endif
+            CPUsPonderPlayed(choice);
+        }
         
-        insertInColumnAtIndex(choice, players[turn], board, currBallY);
+        int row = insertInColumnAtIndex(choice, players[turn], board, currBallY);
+
+        if (row >= 0 && winTrackerPlay(&tracker, choice, kBOARDS_ROWS -1 -row, turn)) {
+            winTrackerCells(&tracker, board->winningCells);
+            finishAnimations();
+            if (recorder != NULL) recordEnd(recorder, (turn == 0 ? RecordResultFirstPlayer : RecordResultSecondPlayer));
+            return players[turn];
+        }
 
-        char winner = winningPlayer(board);
-        if (winner == kEMPTY) {
-            turn = (turn +1)%2;
-            continue;
-        } else return winner;
+        turn = (turn +1)%2;
     }
 }
 
@@ -521,6 +669,14 @@ int newGame(Board *board, GameMode gameMode, Statistics *stats) {
 
 ////////////////////// SERVICE //////////////////////
 
+// Runs the frames of the animations left, the CPU searching in the spare time of each
+void playAnimationsOut() {
+    while (animationsRunning()) {
+        CPUsPonder(kPONDER_SLICE_US);
+        endFrame();
+    }
+}
+
 void animateLEDs() {
     
     int seq[6] = {0b1000,0b0100,0b0010,0b0001,0b0010,0b0100};
@@ -530,202 +686,211 @@ void animateLEDs() {
     
     int i;
     for (i = 0; i<seqLen*reps; ++i) {
-        XGpio_DiscreteWrite(&output, 1, seq[i%seqLen]);
-        usleep(interval_ms*1000);
+        halWriteLEDs(seq[i%seqLen]);
+        halSleepMicros(interval_ms*1000);
     }
 }
 
 GameMode askForGameMode() {
 
-    DEBOUNCE;
+    inputFlush();
 
-    char switch_data = -1;
-    char old_switch_data = -1;
-    uint32_t *pp = kPOINTERBRAM;
+    InputEvent event;
+    char switch_data = inputSwitches();
+    BOOL redraw = true;
 
     GameMode mode = GameModeInvalid;
 
-    while (XGpio_DiscreteRead(&input, 1) == 0) {
-
-        switch_data = XGpio_DiscreteRead(&input, 2);
+    // Redrawn at every change of the switches, until a button is pressed
+    while (1) {
 
-        if (switch_data != old_switch_data) {
+        if (redraw) {
 
-            XGpio_DiscreteWrite(&output, 1, switch_data&0b0111);
-            old_switch_data = switch_data;
+            halWriteLEDs(switch_data&0b0111);
 
-            clearBram();
+            displayClear();
 
-            drawLabel(640/2,480/2-50,"connect 4",CYAN,&pp[1]);
-            drawLabel(640/2,450,"press any button to start",YELLOW,&pp[9]);
+            newLabel(640/2,480/2-50,"connect 4",CYAN);
+            newLabel(640/2,450,"press any button to start",YELLOW);
             
             if ((switch_data>>2)%2 != 0) {
                 
-                drawLabel(640/2,480/2,"DEMO MODE",RED,&pp[30]);
+                newLabel(640/2,480/2,"DEMO MODE",RED);
                 mode = GameModeDemo;
                 
             } else if (switch_data%2 == 0) {
 
-                drawLabel(640/2,480/2,"PLAYER VS player",WHITE,&pp[30]);
+                newLabel(640/2,480/2,"PLAYER VS player",WHITE);
                 mode = GameModePlayerVsPlayer;
 
             } else {
 
-                drawLabel(640/2,480/2,"PLAYER VS CPU",WHITE,&pp[30]);
+                newLabel(640/2,480/2,"PLAYER VS CPU",WHITE);
                 
-                if ((switch_data>>1)%2 == 0) {
-                    drawLabel(640/2,480/2+30,"EASY",GREEN,&pp[41]);
+                if ((switch_data>>3)%2 != 0) {
+                    newLabel(640/2,480/2+30,"EXPERT",MAGENTA);
+                    mode = GameModePlayerVsCPUExpert;
+                } else if ((switch_data>>1)%2 == 0) {
+                    newLabel(640/2,480/2+30,"EASY",GREEN);
                     mode = GameModePlayerVsCPUEasy;  
                 } else {
-                    drawLabel(640/2,480/2+30,"HARD",RED,&pp[41]);
+                    newLabel(640/2,480/2+30,"HARD",RED);
                     mode = GameModePlayerVsCPUHard;
                 }
             }
+
+            displayFlush();
         }
 
-        usleep(20000);
-    }
+        // No game to start
+        if (!inputWait(&event, kINPUT_FOREVER)) return GameModeInvalid;
 
-    DEBOUNCE;
+        redraw = (event.type == InputEventSwitches);
+        if (redraw) switch_data = event.switches;
+        if (redraw || event.type == InputEventButtonDown) inputHandled(&event);
+        if (event.type == InputEventButtonDown) break;
+    }
 
     return mode;
 }
 
-void gameOverAnimation(uint8_t m[2][4], int winner, BOOL isDemo, int matchNumber) {
+void gameOverAnimation(uint8_t m[2][kLEN_TO_WIN], int winner, BOOL isDemo, int matchNumber) {
     
-    clearBram();
-    grid_on[0] = 1;
+    displayClear();
+    displaySetGrid(true);
     
     uint16_t labelXCenter = 560;
     uint16_t labelYCenter = 200;
     
-    uint32_t *pp = kPOINTERBRAM;
-    
     uint8_t playerColor = YELLOW;
 
     if (isDemo) {
 
         char counterStr[30] = "";
-        sprintf(counterStr, "%i out of %i", matchNumber, maxDemoMatches);
-        drawLabel(labelXCenter, labelYCenter-30, counterStr, WHITE, &pp[16]); // len 11
+        snprintf(counterStr, sizeof(counterStr), "%i out of %i", matchNumber, maxDemoMatches);
+        newLabel(labelXCenter, labelYCenter-30, counterStr, WHITE);
     }
 
     switch (winner) {
         case kPLAYER_1:
-            drawLabel(labelXCenter,labelYCenter,"Player 1 wins",kPLAYER_1_COL,&pp[1]);
+            newLabel(labelXCenter,labelYCenter,"Player 1 wins",kPLAYER_1_COL);
             playerColor = kPLAYER_1_COL;
             break;
         case kPLAYER_2:
-            drawLabel(labelXCenter,labelYCenter,"Player 2 wins",kPLAYER_2_COL,&pp[1]);
+            newLabel(labelXCenter,labelYCenter,"Player 2 wins",kPLAYER_2_COL);
             playerColor = kPLAYER_2_COL;
             break;
         case kCPU_HARD:
             if (isDemo) {
-                drawLabel(labelXCenter,labelYCenter,"CPU HARD wins",kCPU_HARD_COL,&pp[1]);
+                newLabel(labelXCenter,labelYCenter,"CPU HARD wins",kCPU_HARD_COL);
             } else {
-                drawLabel(labelXCenter,labelYCenter,"CPU wins",kCPU_HARD_COL,&pp[1]);
+                newLabel(labelXCenter,labelYCenter,"CPU wins",kCPU_HARD_COL);
             }
             playerColor = kCPU_HARD_COL;
             break;
         case kCPU_EASY:
             if (isDemo) {
-                drawLabel(labelXCenter,labelYCenter,"CPU EASY wins",kCPU_EASY_COL,&pp[1]);
+                newLabel(labelXCenter,labelYCenter,"CPU EASY wins",kCPU_EASY_COL);
             } else {
-                drawLabel(labelXCenter,labelYCenter,"CPU wins",kCPU_EASY_COL,&pp[1]);
+                newLabel(labelXCenter,labelYCenter,"CPU wins",kCPU_EASY_COL);
             }
             playerColor = kCPU_EASY_COL;
             break;
+        case kCPU_EXPERT:
+            newLabel(labelXCenter,labelYCenter,"CPU wins",kCPU_EXPERT_COL);
+            playerColor = kCPU_EXPERT_COL;
+            break;
         default:
-            drawLabel(labelXCenter,labelYCenter,"It is a tie",WHITE,&pp[1]);
-            usleep(1500000);
+            newLabel(labelXCenter,labelYCenter,"It is a tie",WHITE);
+            displayFlush();
+            halSleepMicros(1500000);
             return;
     }
 
-    int offset = (isDemo? 12 : 12);
+    int offset = displayAlloc(kLEN_TO_WIN);
+    uint32_t lit[kLEN_TO_WIN], unlit[kLEN_TO_WIN];
     
-    int i;
+    int i, s;
+    for (s=0; s<kLEN_TO_WIN; ++s) {
+        lit[s] = encodeShape(xForColumn(m[0][s]), yForRow(m[1][s]), playerColor, kBALL_SHAPE);
+        unlit[s] = encodeShape(xForColumn(m[0][s]), yForRow(m[1][s]), BLACK, kBALL_SHAPE);
+    }
+
     for (i=0; i<=30; ++i) {
         
-        uint8_t thisColor = (i%2 == 0 ? playerColor : BLACK);
-        
-        pp[offset+0] = encodeShape(xForColumn(m[0][0]), yForRow(m[1][0]), thisColor, kBALL_SHAPE);
-        pp[offset+1] = encodeShape(xForColumn(m[0][1]), yForRow(m[1][1]), thisColor, kBALL_SHAPE);
-        pp[offset+2] = encodeShape(xForColumn(m[0][2]), yForRow(m[1][2]), thisColor, kBALL_SHAPE);
-        pp[offset+3] = encodeShape(xForColumn(m[0][3]), yForRow(m[1][3]), thisColor, kBALL_SHAPE);
+        for (s=0; s<kLEN_TO_WIN; ++s) {
+            displaySet(offset+s, (i%2 == 0 ? lit[s] : unlit[s]));
+        }
         
-        usleep(100000);
+        displayFlush();
+        halSleepMicros(100000);
     }
 }
 
 void waitTilReset() {
     
-	DEBOUNCE;
+    inputFlush();
 
-    uint32_t *pp = kPOINTERBRAM;
+    newLabel(640/2, 450, "press any button to restart", YELLOW);
+    displayFlush();
     
-    while (XGpio_DiscreteRead(&input, 1) == 0) {
-        
-        drawLabel(640/2, 450, "press any button to restart", YELLOW, &pp[18]);
-        
-        usleep(10000);
-    }
-
-    DEBOUNCE;
+    waitForButton();
 }
 
 void demoWelcomeScreen() {
 
-    clearBram();
+    displayClear();
 
-    uint32_t *pp = kPOINTERBRAM;
+    newLabel(320, 100, "WELCOME TO DEMO MODE", CYAN);
+    newLabel(276, 224, "CPU HARD", RED);
+    newLabel(422, 224, "CPU EASY", GREEN);
+    newLabel(171, 258, "MAX DEPTH:", WHITE);
+    newLabel(277, 258, "7", RED);
+    newLabel(421, 258, "4", GREEN);
+    newLabel(348, 224, "VS", WHITE);
 
-    drawLabel(320, 100, "WELCOME TO DEMO MODE", CYAN, &pp[1]);
-    drawLabel(276, 224, "CPU HARD", RED, &pp[18]);
-    drawLabel(422, 224, "CPU EASY", GREEN, &pp[25]);
-    drawLabel(171, 258, "MAX DEPTH:", WHITE, &pp[32]);
-    drawLabel(277, 258, "7", RED, &pp[41]);
-    drawLabel(421, 258, "4", GREEN, &pp[42]);
-    drawLabel(348, 224, "VS", WHITE, &pp[43]);
 
+    int numberSlot = displayAlloc(labelSlots("####"));
 
-    int switch_data = -1;
-    int old_switch_data = -1;
+    inputFlush();
 
-    DEBOUNCE;
+    InputEvent event;
+    int switch_data = inputSwitches();
+    BOOL redraw = true;
 
-    while (XGpio_DiscreteRead(&input, 1) == 0) {
+    while (1) {
 
-        switch_data = XGpio_DiscreteRead(&input, 2);
+        if (redraw) {
 
-        if (switch_data != old_switch_data) {
+            halWriteLEDs(switch_data&0b0111);
 
-            XGpio_DiscreteWrite(&output, 1, switch_data&0b0111);
-            old_switch_data = switch_data;
+            drawLabel(320, 418, "####", WHITE, numberSlot);
 
-            drawLabel(320, 418, "####", WHITE, &pp[45]);
+            char numb[12] = "";
 
-            char numb[10] = "";
+            snprintf(numb, sizeof(numb), "%d", switch_data *10 +1);
 
-            sprintf(numb, "%d", switch_data *10 +1);
+            drawLabel(320, 418, numb, WHITE, numberSlot);
 
-            drawLabel(320, 418, numb, WHITE, &pp[45]);
+            displayFlush();
         }
 
-        usleep(20000);
+        if (!inputWait(&event, kINPUT_FOREVER)) break;
+
+        redraw = (event.type == InputEventSwitches);
+        if (redraw) switch_data = event.switches;
+        if (redraw || event.type == InputEventButtonDown) inputHandled(&event);
+        if (event.type == InputEventButtonDown) break;
     }
 
     maxDemoMatches = switch_data *10 +1;
-
-    DEBOUNCE;
 }
 
 void displayStatistics(Statistics stats) {
 
-    DEBOUNCE;
-
-    clearBram();
+    inputFlush();
 
-    uint32_t *pp = kPOINTERBRAM;
+    displayClear();
 
     uint32_t totalTime = stats.timeOfCPU1 + stats.timeOfCPU2;
     uint32_t totalMatches = stats.victoriesCPU1 + stats.victoriesCPU2 + stats.ties;
@@ -739,36 +904,35 @@ void displayStatistics(Statistics stats) {
     char winsTies[10] = "";
 
 
-    sprintf(timeEasy, "%lu?",(uint32_t)ceil(stats.timeOfCPU2*100.0 /totalTime));
-    sprintf(winsEasy, "%lu?",(uint32_t)round(stats.victoriesCPU2*100 /totalMatches));
+    snprintf(timeEasy, sizeof(timeEasy), "%u?", percent(ceil(stats.timeOfCPU2*100.0 /totalTime)));
+    snprintf(winsEasy, sizeof(winsEasy), "%u?", percent(round(stats.victoriesCPU2*100 /totalMatches)));
 
-    sprintf(timeHard, "%lu?",(uint32_t)(stats.timeOfCPU1*100.0 /totalTime));
-    sprintf(winsHard, "%lu?",(uint32_t)round(stats.victoriesCPU1*100 /totalMatches));
+    snprintf(timeHard, sizeof(timeHard), "%u?", percent(stats.timeOfCPU1*100.0 /totalTime));
+    snprintf(winsHard, sizeof(winsHard), "%u?", percent(round(stats.victoriesCPU1*100 /totalMatches)));
 
-    sprintf(winsTies, "%lu?",(uint32_t)round(stats.ties*100 /totalMatches));
+    snprintf(winsTies, sizeof(winsTies), "%u?", percent(round(stats.ties*100 /totalMatches)));
 
-    drawLabel(204, 221, "HARD", RED, &pp[1]);
-    drawLabel(204, 251, "EASY", GREEN, &pp[5]);
-    drawLabel(204, 325, "TIES", YELLOW, &pp[9]);
-    drawLabel(311, 175, "TIME", WHITE, &pp[13]);
-    drawLabel(451, 175, "VICTORIES", WHITE, &pp[17]);
+    newLabel(204, 221, "HARD", RED);
+    newLabel(204, 251, "EASY", GREEN);
+    newLabel(204, 325, "TIES", YELLOW);
+    newLabel(311, 175, "TIME", WHITE);
+    newLabel(451, 175, "VICTORIES", WHITE);
 
-    drawLabel(311, 221, timeHard, RED, &pp[26]); // TIME
-    drawLabel(451, 221, winsHard, RED, &pp[32]); // VICTORIES
+    newLabel(311, 221, timeHard, RED); // TIME
+    newLabel(451, 221, winsHard, RED); // VICTORIES
 
-    drawLabel(311, 251, timeEasy, GREEN, &pp[29]); // TIME
-    drawLabel(451, 251, winsEasy, GREEN, &pp[35]); // VICTS
+    newLabel(311, 251, timeEasy, GREEN); // TIME
+    newLabel(451, 251, winsEasy, GREEN); // VICTS
 
-    drawLabel(451, 325, winsTies, YELLOW, &pp[38]);
+    newLabel(451, 325, winsTies, YELLOW);
 
-    drawLabel(154, 236, "CPU", WHITE, &pp[41]);
-    drawLabel(320, 68, "STATS", CYAN, &pp[44]);
+    newLabel(154, 236, "CPU", WHITE);
+    newLabel(320, 68, "STATS", CYAN);
 
 
-    while(XGpio_DiscreteRead(&input, 1) == 0)   usleep(10000);       
-    
+    displayFlush();
 
-    DEBOUNCE;
+    waitForButton();
 }
 
 /////////////////////////////////////////////////////
@@ -778,6 +942,36 @@ void displayStatistics(Statistics stats) {
 
 ///////////////////// UTILITIES /////////////////////
 
+// Until a button is pressed, or no more input can come
+void waitForButton() {
+
+    InputEvent event;
+
+    while (inputWait(&event, kINPUT_FOREVER)) {
+        if (event.type == InputEventButtonDown) {
+            inputHandled(&event);
+            return;
+        }
+    }
+}
+
+// Within 0-100, so that it fits its label
+uint8_t percent(double value) {
+    return (uint8_t)(value < 0 ? 0 : (value > 100 ? 100 : value));
+}
+
+// Depth of the fitness CPUs' searches
+int depthForCPU(char cpu) {
+    return (cpu == kCPU_HARD ? kCPU_HARD_MAX_DEPTH : kCPU_EASY_MAX_DEPTH);
+}
+
+// Engine setting kept in game records
+uint16_t recordedSetting(char player) {
+    if (player == kCPU_EXPERT) return kCPU_EXPERT_TIME_MS;
+    if (player == kCPU_HARD || player == kCPU_EASY) return depthForCPU(player);
+    return 0;
+}
+
 uint64_t randFromClock() {
     XTime tickTocks;  
     XTime_GetTime(&tickTocks);
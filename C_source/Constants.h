@@ -3,16 +3,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include "platform.h"
-#include <xgpio.h>
-#include "xparameters.h"
-#include "sleep.h"
-#include "xtime_l.h"
+#include "HAL.h"
 
 
 
+// Board geometry, fixed at compile time. Host builds may override it, e.g.
+// -DkBOARDS_COLS=9 -DkBOARDS_ROWS=7 -DkLEN_TO_WIN=5 (see Host_tools/Makefile).
+#ifndef kBOARDS_COLS
 #define kBOARDS_COLS        7
+#endif
+#ifndef kBOARDS_ROWS
 #define kBOARDS_ROWS        6
+#endif
+#ifndef kLEN_TO_WIN
+#define kLEN_TO_WIN         4
+#endif
+#define kBOARDS_CELLS       (kBOARDS_COLS *kBOARDS_ROWS)
+
+// The VGA design draws the 7x6 grid and has room for its discs only
+#if !defined(HOST_BUILD) && (kBOARDS_COLS != 7 || kBOARDS_ROWS != 6 || kLEN_TO_WIN != 4)
+#error "The board build only supports 7 columns, 6 rows and 4 to win"
+#endif
 #define kXFIRSTCENTER       67.5
 #define kYFIRSTCENTER       87.5
 #define kBOARDTHICKNESS     15
@@ -20,13 +31,20 @@
 
 #define kERROR_FACTOR	    20
 
+#define kMAX_SEARCH_THREADS 64
+
 #define kCPU_EASY_MAX_DEPTH  4
 #define kCPU_HARD_MAX_DEPTH  7
+#define kCPU_EXPERT_MAX_DEPTH 16
+#define kCPU_EXPERT_TIME_MS  1000
+#define kPONDER_SLICE_US     10000  // Of every frame the CPU waits through, to ponder
+#define kFRAME_US            16667  // 60 Hz
 
 #define kPLAYER_1       '*'
 #define kPLAYER_2       'o'
 #define kCPU_HARD       '$'
 #define kCPU_EASY       '%'
+#define kCPU_EXPERT     '&'
 #define kEMPTY          '_'
 
 #define WHITE           0b111
@@ -42,12 +60,9 @@
 #define kPLAYER_2_COL   YELLOW
 #define kCPU_HARD_COL   RED
 #define kCPU_EASY_COL   GREEN
+#define kCPU_EXPERT_COL MAGENTA
 
-#define kLEN_TO_WIN     4
-
-#define kFIRST_TURN     rand()%2
-
-#define kPOINTERBRAM    (uint32_t*)0x40000000
+#define kPOINTERBRAM    (halShapeBuffer())
 
 #define NOINPUT			0b0000
 #define BUTTON_0        0b0001
@@ -59,11 +74,9 @@
 
 #define sign(theArg) ((theArg > 0) - (theArg < 0))
 
-#define DEBOUNCE while(XGpio_DiscreteRead(&input, 1) != 0) usleep(10000)
-
 #define canInsertInColumnAtIndex(_index,_boardPT) (!(_index < 0 || _index >= kBOARDS_COLS || _boardPT->matrix[0][_index] != kEMPTY))
 
-#define colorForPlayer(_player) (_player == kPLAYER_1 ? kPLAYER_1_COL : (_player == kPLAYER_2 ? kPLAYER_2_COL : (_player == kCPU_HARD ? kCPU_HARD_COL : (_player == kCPU_EASY ? kCPU_EASY_COL : BLACK))))
+#define colorForPlayer(_player) (_player == kPLAYER_1 ? kPLAYER_1_COL : (_player == kPLAYER_2 ? kPLAYER_2_COL : (_player == kCPU_HARD ? kCPU_HARD_COL : (_player == kCPU_EASY ? kCPU_EASY_COL : (_player == kCPU_EXPERT ? kCPU_EXPERT_COL : BLACK)))))
 
 #define xForColumn(_indx) ((uint16_t)(kXFIRSTCENTER +(_indx)*(kLENGHTSPACE + kBOARDTHICKNESS)))
 
@@ -90,6 +103,7 @@ typedef enum {
 typedef enum {
     GameModePlayerVsCPUHard,
     GameModePlayerVsCPUEasy,
+    GameModePlayerVsCPUExpert,
     GameModePlayerVsPlayer,
     GameModeDemo,
     GameModeInvalid
@@ -98,13 +112,14 @@ typedef enum {
 typedef struct {
     uint32_t timeOfCPU1, timeOfCPU2; // in sec
     uint32_t victoriesCPU1, victoriesCPU2, ties;
+    uint8_t depthOfCPU1, depthOfCPU2; // deepest search completed
 } Statistics;
 
 typedef struct {
     char matrix[kBOARDS_ROWS][kBOARDS_COLS];
     int emptyCells;
     int n_balls;
-    uint8_t winningCells[2][4];
+    uint8_t winningCells[2][kLEN_TO_WIN];
 } Board;
 
 #endif
@@ -0,0 +1,87 @@
+#include "DisplayList.h"
+#include "Input.h"
+#include <string.h>
+
+#define kDIRTY_WORDS        ((kDISPLAY_SLOTS +31)/32)
+
+static uint32_t shadow[kDISPLAY_SLOTS];  // Drawn into
+static uint32_t front[kDISPLAY_SLOTS];   // As last flushed to the shape memory
+static uint32_t dirty[kDIRTY_WORDS];     // One bit per slot set since the last flush
+static int nextFree;                    // Slots are handed out in order
+static uint32_t wordsFlushed;
+
+void displayInit() {
+
+    int i;
+
+    // Whatever the memory holds, it's overwritten by the first flush
+    memset(shadow, 0, sizeof(shadow));
+    memset(front, 0xFF, sizeof(front));
+    for (i=0; i<kDIRTY_WORDS; ++i) dirty[i] = 0xFFFFFFFF;
+
+    nextFree = kDISPLAY_GRID_SLOT +1;
+    wordsFlushed = 0;
+}
+
+void displayClear() {
+
+    int i;
+
+    for (i=0; i<kDISPLAY_SLOTS; ++i) displaySet(i, 0);
+    nextFree = kDISPLAY_GRID_SLOT +1;
+}
+
+int displayAlloc(int count) {
+
+    if (count < 0 || nextFree +count > kDISPLAY_SLOTS) return -1;
+
+    int slot = nextFree;
+    nextFree += count;
+
+    return slot;
+}
+
+void displaySet(int slot, uint32_t word) {
+    if (slot < 0 || slot >= kDISPLAY_SLOTS || shadow[slot] == word) return;
+    shadow[slot] = word;
+    dirty[slot/32] |= 1u << (slot%32);
+}
+
+void displaySetGrid(BOOL on) {
+    displaySet(kDISPLAY_GRID_SLOT, (on ? 1 : 0));
+}
+
+void displayFlush() {
+
+    uint32_t *pp = kPOINTERBRAM;
+    uint32_t before = wordsFlushed;
+    int i;
+
+    for (i=0; i<kDIRTY_WORDS; ++i) {
+
+        uint32_t bits = dirty[i];
+        dirty[i] = 0;
+
+        // In increasing address order. Words changed and changed back
+        // (a screen cleared and drawn again) aren't written.
+        while (bits != 0) {
+            int slot = i*32 +__builtin_ctz(bits);
+            if (slot < kDISPLAY_SLOTS && front[slot] != shadow[slot]) {
+                pp[slot] = front[slot] = shadow[slot];
+                ++wordsFlushed;
+            }
+            bits &= bits -1;
+        }
+    }
+
+#ifdef HOST_BUILD
+    halShapesFlushed();
+#endif
+
+    // An input's answer is on the screen once written
+    if (wordsFlushed != before) inputShown();
+}
+
+uint32_t displayWordsFlushed() {
+    return wordsFlushed;
+}
@@ -0,0 +1,39 @@
+#ifndef DISPLAY_LIST
+#define DISPLAY_LIST
+
+#include "Constants.h"
+
+// Shadow copy of the shape memory the VGA controller scans out: word 0
+// turns the grid on, each of the others is a shape (see encodeShape()).
+// Drawing only changes the shadow. displayFlush(), once per frame, copies
+// the words that changed since the last flush in one pass, so the
+// controller never shows a half-drawn frame and the bus only carries
+// changes. Shapes get their words from displayAlloc(), and displayClear()
+// frees them all.
+
+#define kDISPLAY_GRID_SLOT  0
+
+// Boards larger than the VGA design's have more discs than it has slots
+#ifdef HOST_BUILD
+#define kDISPLAY_SLOTS      (kSHAPE_SLOTS +kBOARDS_CELLS)
+#else
+#define kDISPLAY_SLOTS      kSHAPE_SLOTS
+#endif
+
+// Takes over the shape memory and blanks it
+void displayInit();
+
+// Blanks every shape and the grid, and frees every slot
+void displayClear();
+
+// First of count consecutive free slots, -1 if there aren't as many
+int displayAlloc(int count);
+
+void displaySet(int slot, uint32_t word);
+void displaySetGrid(BOOL on);
+void displayFlush();
+
+// Words written to the shape memory since displayInit()
+uint32_t displayWordsFlushed();
+
+#endif
@@ -1,5 +1,6 @@
 #include "Drawer.h"
 #include <ctype.h>
+#include <string.h>
 
 
 uint32_t encodeShape(uint16_t xpos, uint16_t ypos, uint8_t color, uint8_t shape){
@@ -9,14 +10,6 @@ uint32_t encodeShape(uint16_t xpos, uint16_t ypos, uint8_t color, uint8_t shape)
     return (xpos<<22) + (ypos<<13) + (color<<10) + (shape<<2);
 }
 
-void clearBram(){
-	uint32_t *pp = kPOINTERBRAM;
-	int i;
-	for(i=0;i<51;++i){
-		pp[i]=0;
-	}
-}
-
 int shapeForChar(char theChar) {
     if (toupper((int)theChar) >= 'A' && toupper((int)theChar)<= 'Z') {
         // letter
@@ -41,7 +34,18 @@ int shapeForChar(char theChar) {
     }
 }
 
-void drawLabel(uint16_t xpos, uint16_t ypos, const char str[], uint8_t color, uint32_t *pp) {
+int labelSlots(const char str[]) {
+
+    int i, n = 0;
+
+    for (i=0; str[i] != '\0'; ++i) {
+        if (shapeForChar(str[i]) != -1) ++n;
+    }
+
+    return n;
+}
+
+void drawLabel(uint16_t xpos, uint16_t ypos, const char str[], uint8_t color, int slot) {
 
     int i,theStrLen = strlen(str);
 
@@ -55,13 +59,23 @@ void drawLabel(uint16_t xpos, uint16_t ypos, const char str[], uint8_t color, ui
         int shape = shapeForChar(thisChar);
 
         if (shape == -2) {
-            *pp = 0;
-            ++pp;
+            displaySet(slot, 0);
+            ++slot;
         } else if (shape != -1) {
-            *pp = encodeShape(curr_xpos, ypos, color, shape);
-            ++pp;
+            displaySet(slot, encodeShape(curr_xpos, ypos, color, shape));
+            ++slot;
         }
 
         curr_xpos += kTEXT_CHAR_WIDTH + kTEXT_SPACING;
     }
 }
+
+// Draws the label in slots of its own, returns the first one (-1 if it doesn't fit)
+int newLabel(uint16_t xpos, uint16_t ypos, const char str[], uint8_t color) {
+
+    int slot = displayAlloc(labelSlots(str));
+
+    if (slot >= 0) drawLabel(xpos, ypos, str, color, slot);
+
+    return slot;
+}
@@ -2,6 +2,7 @@
 #define PHYSISCS
 
 #include "Constants.h"
+#include "DisplayList.h"
 
 #define kTEXT_CHAR_WIDTH    15
 #define kTEXT_CHAR_HEIGHT   15
@@ -12,8 +13,11 @@
 uint32_t encodeShape(uint16_t xpos, uint16_t ypos, uint8_t color, uint8_t shape);
 uint16_t row(int i);
 uint16_t col(int i);
-void drawLabel(uint16_t xpos, uint16_t ypos, const char str[], uint8_t color, uint32_t *pp);
+
+// Labels take one display slot per character but spaces; '#' blanks its slot.
+int labelSlots(const char str[]);
+void drawLabel(uint16_t xpos, uint16_t ypos, const char str[], uint8_t color, int slot);
+int newLabel(uint16_t xpos, uint16_t ypos, const char str[], uint8_t color);
 int shapeForChar(char theChar);
-void clearBram();
 
 #endif
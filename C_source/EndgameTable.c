@@ -0,0 +1,106 @@
+#include "EndgameTable.h"
+#include "OpeningBook.h"
+
+#ifdef USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define kKEY_SCRAMBLE       0x9E3779B97F4A7C15ULL
+
+uint64_t endgameKeyForPosition(const Position *pos, int who) {
+    return bookKeyForPosition(pos, who, NULL) *kKEY_SCRAMBLE;
+}
+
+// Points the table at data already in memory. Nothing is copied, so data
+// must outlive the table.
+BOOL endgameAttach(EndgameTable *table, const void *data, size_t length) {
+
+    const EndgameHeader *header = (const EndgameHeader *) data;
+
+    table->header = NULL;
+    table->mapping = NULL;
+    table->length = length;
+
+    if (data == NULL || length < sizeof(EndgameHeader)) return false;
+    if (header->magic != kENDGAME_MAGIC || header->version != kENDGAME_VERSION) return false;
+    if (header->cols != kBOARDS_COLS || header->rows != kBOARDS_ROWS || header->lenToWin != kLEN_TO_WIN) return false;
+    if (header->indexBits > 24) return false;
+
+    size_t bucketsSize = endgameBucketsSize(header->indexBits);
+
+    if (length < sizeof(EndgameHeader) +bucketsSize +(size_t)header->count*(sizeof(uint64_t) +1)) return false;
+
+    table->header = header;
+    table->buckets = (const uint32_t *)(header +1);
+    table->keys = (const uint64_t *)((const uint8_t *)table->buckets +bucketsSize);
+    table->scores = (const int8_t *)(table->keys +header->count);
+
+    return true;
+}
+
+// TRUE and the exact score if the position is in the table.
+BOOL endgameProbe(const EndgameTable *table, const Position *pos, int who, int *score) {
+
+    if (table == NULL || table->header == NULL) return false;
+    if (kBOARDS_CELLS -pos->nMoves > table->header->maxEmpty) return false;
+
+    uint64_t key = endgameKeyForPosition(pos, who);
+    int bits = table->header->indexBits;
+    uint32_t bucket = (bits == 0 ? 0 : (uint32_t)(key >> (64 -bits)));
+
+    uint32_t lo = table->buckets[bucket], hi = table->buckets[bucket +1];
+
+    while (lo < hi) {
+        uint32_t mid = lo +(hi -lo)/2;
+        if (table->keys[mid] < key) lo = mid +1;
+        else hi = mid;
+    }
+
+    if (lo >= table->buckets[bucket +1] || table->keys[lo] != key) return false;
+
+    *score = table->scores[lo];
+
+    return true;
+}
+
+#ifdef USE_MMAP
+
+BOOL endgameOpen(EndgameTable *table, const char *path) {
+
+    table->header = NULL;
+    table->mapping = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return false;
+
+    if (!endgameAttach(table, data, (size_t)st.st_size)) {
+        munmap(data, (size_t)st.st_size);
+        return false;
+    }
+
+    table->mapping = data;
+
+    return true;
+}
+
+void endgameClose(EndgameTable *table) {
+    if (table->mapping != NULL) munmap(table->mapping, table->length);
+    table->mapping = NULL;
+    table->header = NULL;
+}
+
+#endif
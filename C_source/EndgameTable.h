@@ -0,0 +1,54 @@
+#ifndef ENDGAME_TABLE
+#define ENDGAME_TABLE
+
+#include "Constants.h"
+#include "Bitboard.h"
+
+// Table file, little endian, used in place like the opening book:
+//
+//   EndgameHeader
+//   uint32_t buckets[(1 << indexBits) +1]    first entry of each bucket
+//   (padding to 8 bytes)
+//   uint64_t keys[count]                     sorted, see endgameKeyForPosition()
+//   int8_t   scores[count]                   exact Solver score for the player to move
+//
+// Keys are book keys scrambled by an invertible multiply, so that their top
+// indexBits spread evenly over the buckets.
+
+#define kENDGAME_MAGIC      0x47453443      // "C4EG"
+#define kENDGAME_VERSION    2
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t cols, rows;
+    uint8_t maxEmpty;               // Holds positions with up to this many empty cells
+    uint8_t indexBits;
+    uint8_t lenToWin;
+    uint8_t reserved;
+    uint32_t count;
+    uint32_t padding[2];
+} EndgameHeader;
+
+typedef struct {
+    const EndgameHeader *header;
+    const uint32_t *buckets;
+    const uint64_t *keys;
+    const int8_t *scores;
+    void *mapping;                  // Non-NULL when endgameOpen() mapped a file
+    size_t length;
+} EndgameTable;
+
+#define endgameBucketsSize(_indexBits) ((((((size_t)1 << (_indexBits)) +1)*sizeof(uint32_t)) +7) & ~(size_t)7)
+
+uint64_t endgameKeyForPosition(const Position *pos, int who);
+
+BOOL endgameAttach(EndgameTable *table, const void *data, size_t length);
+BOOL endgameProbe(const EndgameTable *table, const Position *pos, int who, int *score);
+
+#ifdef USE_MMAP
+BOOL endgameOpen(EndgameTable *table, const char *path);
+void endgameClose(EndgameTable *table);
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+#include "Evaluation.h"
+
+#if kBB_CELLS <= 64
+#define bitboardCount(_b) __builtin_popcountll(_b)
+#else
+#define bitboardCount(_b) (__builtin_popcountll((uint64_t)(_b)) + __builtin_popcountll((uint64_t)((_b) >> 64)))
+#endif
+
+// They depend on the geometry only, so the compiler folds them.
+#define kCOLUMN_BITS        ((((Bitboard)1) << kBOARDS_ROWS) -1)
+#define kCENTER_MASK        ((kCOLUMN_BITS << cellIndex(kBOARDS_COLS/2, 0)) \
+                            | (kBOARDS_COLS%2 == 0 ? kCOLUMN_BITS << cellIndex(kBOARDS_COLS/2 -1, 0) : 0))
+
+// Threats on odd rows (from 1 at the bottom) favor the first player, on even
+// rows the second: with the rest of the board full, the zugzwang hands them
+// the cell below. Indexed by player, 0 moved first.
+#define kPARITY_MASK(_p)    (kBB_BOTTOM *(kCOLUMN_BITS & ((_p) ? (Bitboard)0xAAAAAAAAAAAAAAAAull : (Bitboard)0x5555555555555555ull)))
+
+// An open window has no disc of the opponent, and never kLEN_TO_WIN of mine
+// (it would be a win), so a count of its discs up to kLEN_TO_WIN -1 fits in
+// two bit-sliced counters for lines of 4, three for longer ones.
+#if kLEN_TO_WIN <= 4
+#define countIs(_n) (((_n) & 1 ? c0 : ~c0) & ((_n) & 2 ? c1 : ~c1))
+#else
+#define countIs(_n) (((_n) & 1 ? c0 : ~c0) & ((_n) & 2 ? c1 : ~c1) & ((_n) & 4 ? c2 : ~c2))
+#endif
+
+typedef struct {
+    Bitboard threats;   // Cells of the windows missing one disc: the empty ones complete them
+    int twos;           // Open windows missing two discs
+} SideWindows;
+
+// Scans the windows in direction dir for both players at once, one bit per
+// window (at its first cell). The discs in a window are counted once for
+// both: in a window open to a player, they are all theirs.
+static inline void scanWindows(Bitboard discs0, Bitboard discs1, Bitboard empty, int dir, SideWindows sides[2]) {
+
+    Bitboard occupied = discs0 | discs1;
+    Bitboard free0 = discs0 | empty, free1 = discs1 | empty;
+    Bitboard open0 = free0, open1 = free1;
+    Bitboard c0 = occupied, c1 = 0;
+#if kLEN_TO_WIN > 4
+    Bitboard c2 = 0;
+#endif
+    int s;
+
+    for (s=1; s<kLEN_TO_WIN; ++s) {
+
+        Bitboard x = occupied >> (s*dir);
+        open0 &= free0 >> (s*dir);
+        open1 &= free1 >> (s*dir);
+
+        Bitboard carry0 = c0 & x;
+        c0 ^= x;
+#if kLEN_TO_WIN > 4
+        c2 ^= c1 & carry0;
+#endif
+        c1 ^= carry0;
+    }
+
+    Bitboard threes = countIs(kLEN_TO_WIN -1);
+    Bitboard twos = countIs(kLEN_TO_WIN -2);
+    Bitboard threes0 = open0 & threes, threes1 = open1 & threes;
+
+    // The empty cell of each three, anywhere along its window
+    for (s=0; s<kLEN_TO_WIN; ++s) {
+        sides[0].threats |= threes0 << (s*dir);
+        sides[1].threats |= threes1 << (s*dir);
+    }
+
+    sides[0].twos += bitboardCount(open0 & twos);
+    sides[1].twos += bitboardCount(open1 & twos);
+}
+
+// Vertical windows: discs stack up, so the empty cells of an open window are
+// always its top ones, and one pass per player finds them.
+static inline void scanColumns(const Bitboard discs[2], Bitboard empty, SideWindows sides[2]) {
+
+    Bitboard emptyTop = empty >> (kLEN_TO_WIN -1);
+    Bitboard twoEmptyTop = emptyTop & (empty >> (kLEN_TO_WIN -2));
+    int i, s;
+
+    for (i=0; i<2; ++i) {
+
+        // Windows that start with kLEN_TO_WIN -2 of my discs
+        Bitboard run = discs[i];
+        for (s=1; s<kLEN_TO_WIN -2; ++s) run &= discs[i] >> s;
+
+        sides[i].twos += bitboardCount(run & twoEmptyTop);
+        sides[i].threats |= (run & (discs[i] >> (kLEN_TO_WIN -2)) & emptyTop) << (kLEN_TO_WIN -1);
+    }
+}
+
+int evaluatePosition(const Position *pos, int who) {
+
+    Bitboard empty = kBB_BOARD & ~positionOccupied(pos);
+    SideWindows sides[2] = {{0, 0}, {0, 0}};
+    int score[2];
+    int i;
+
+    // Horizontal and the two diagonals. Constant directions let the compiler
+    // unroll every shift.
+    scanWindows(pos->discs[0], pos->discs[1], empty, kBB_HEIGHT, sides);
+    scanWindows(pos->discs[0], pos->discs[1], empty, kBB_HEIGHT -1, sides);
+    scanWindows(pos->discs[0], pos->discs[1], empty, kBB_HEIGHT +1, sides);
+    scanColumns(pos->discs, empty, sides);
+
+    // Player i moved first if the discs are even and i is to move, or odd
+    // and i isn't
+    for (i=0; i<2; ++i) {
+        Bitboard threats = sides[i].threats & empty;
+        int parity = (pos->nMoves +(i != who)) % 2;
+
+        score[i] = kEVAL_THREE*bitboardCount(threats) + kEVAL_TWO*sides[i].twos
+                  +kEVAL_GOOD_PARITY*bitboardCount(threats & kPARITY_MASK(parity))
+                  +kEVAL_CENTER*bitboardCount(pos->discs[i] & kCENTER_MASK);
+    }
+
+    // The player to move completes a line next
+    if (sides[who].threats & empty & positionPlayableCells(pos)) score[who] += kEVAL_PLAYABLE_THREAT;
+
+    return score[who] -score[(who +1)%2];
+}
@@ -0,0 +1,22 @@
+#ifndef EVALUATION
+#define EVALUATION
+
+#include "Constants.h"
+#include "Bitboard.h"
+
+// Static evaluation of positions the fitness search leaves open at its
+// horizon. Every window of kLEN_TO_WIN cells is scored at once, one bit per
+// window, with shifts and bit-sliced counters on the bitboards. The discs of
+// a window are counted once for both players, and all the masks are
+// compile-time constants.
+
+#define kEVAL_PLAYABLE_THREAT   32  // The player to move completes a line next
+#define kEVAL_THREE             12  // Empty cell that completes a window of mine (a threat)
+#define kEVAL_TWO               2   // Window with all but two discs, the rest empty
+#define kEVAL_GOOD_PARITY       4   // Threat on a row of the right parity (see Evaluation.c)
+#define kEVAL_CENTER            1   // Disc in the center column
+
+// Sum of weights of the player to move minus the opponent's
+int evaluatePosition(const Position *pos, int who);
+
+#endif
@@ -0,0 +1,220 @@
+#include "GameRecord.h"
+#include <string.h>
+
+#ifdef USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static void fileHeader(RecordFileHeader *header) {
+    memset(header, 0, sizeof(RecordFileHeader));
+    header->magic = kRECORD_MAGIC;
+    header->version = kRECORD_VERSION;
+    header->cols = kBOARDS_COLS;
+    header->rows = kBOARDS_ROWS;
+    header->lenToWin = kLEN_TO_WIN;
+    header->moveBits = kRECORD_MOVE_BITS;
+}
+
+static void putLE(uint8_t *bytes, uint64_t value, int n) {
+    int i;
+    for (i=0; i<n; ++i) bytes[i] = (uint8_t)(value >> (8*i));
+}
+
+static uint64_t getLE(const uint8_t *bytes, int n) {
+    uint64_t value = 0;
+    int i;
+    for (i=0; i<n; ++i) value |= (uint64_t)bytes[i] << (8*i);
+    return value;
+}
+
+BOOL recordWriterInit(RecordWriter *writer, FILE *file) {
+
+    RecordFileHeader header, expected;
+
+    writer->file = file;
+    writer->nMoves = 0;
+    writer->games = 0;
+
+    fileHeader(&expected);
+
+    if (fseek(file, 0, SEEK_END) != 0) return false;
+
+    if (ftell(file) == 0) return fwrite(&expected, sizeof(expected), 1, file) == 1;
+
+    if (fseek(file, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, file) != 1) return false;
+    if (memcmp(&header, &expected, sizeof(header)) != 0) return false;
+
+    return fseek(file, 0, SEEK_END) == 0;
+}
+
+void recordBegin(RecordWriter *writer, const char players[2], const uint16_t settings[2], const uint16_t mistakes[2], uint64_t seed, int first) {
+
+    uint8_t *h = writer->bytes;
+
+    memset(writer->bytes, 0, sizeof(writer->bytes));
+
+    h[0] = (uint8_t)players[0];
+    h[1] = (uint8_t)players[1];
+    putLE(h +2, settings[0], 2);
+    putLE(h +4, settings[1], 2);
+    putLE(h +6, mistakes[0], 2);
+    putLE(h +8, mistakes[1], 2);
+    putLE(h +10, seed, 8);
+    h[18] = (uint8_t)first;
+    h[19] = RecordResultAbandoned;
+
+    writer->nMoves = 0;
+}
+
+// Times wait at the end of bytes until the game ends and the move count says
+// where they go.
+void recordMove(RecordWriter *writer, int col, uint32_t micros) {
+
+    if (writer->nMoves >= kBOARDS_CELLS) return;
+
+    uint8_t *moves = writer->bytes +kRECORD_HEADER_BYTES;
+    int bit = writer->nMoves*kRECORD_MOVE_BITS;
+    uint32_t w = (uint32_t)col << (bit%8);
+
+    moves[bit/8] |= (uint8_t)w;
+    if (bit%8 +kRECORD_MOVE_BITS > 8) moves[bit/8 +1] |= (uint8_t)(w >> 8);
+
+    // Past the moves the game could still take
+    writer->bytes[sizeof(writer->bytes) -kBOARDS_CELLS +writer->nMoves] = recordPackMicros(micros);
+
+    ++(writer->nMoves);
+}
+
+void recordOpeningMove(RecordWriter *writer, int col) {
+    recordMove(writer, col, 0);
+    writer->bytes[21] = (uint8_t)writer->nMoves;
+}
+
+BOOL recordEnd(RecordWriter *writer, RecordResult result) {
+
+    int n = writer->nMoves;
+    int moveBytes = (n*kRECORD_MOVE_BITS +7)/8;
+    uint8_t *times = writer->bytes +kRECORD_HEADER_BYTES +moveBytes;
+
+    writer->bytes[19] = (uint8_t)result;
+    writer->bytes[20] = (uint8_t)n;
+    memmove(times, writer->bytes +sizeof(writer->bytes) -kBOARDS_CELLS, n);
+
+    ++(writer->games);
+
+    return fwrite(writer->bytes, 1, kRECORD_HEADER_BYTES +moveBytes +n, writer->file) == (size_t)(kRECORD_HEADER_BYTES +moveBytes +n);
+}
+
+BOOL recordReaderAttach(RecordReader *reader, const void *data, size_t length) {
+
+    RecordFileHeader expected;
+
+    reader->next = NULL;
+    reader->end = NULL;
+    reader->mapping = NULL;
+    reader->length = length;
+
+    fileHeader(&expected);
+
+    if (data == NULL || length < sizeof(RecordFileHeader)) return false;
+    if (memcmp(data, &expected, sizeof(RecordFileHeader)) != 0) return false;
+
+    reader->next = (const uint8_t *)data +sizeof(RecordFileHeader);
+    reader->end = (const uint8_t *)data +length;
+
+    return true;
+}
+
+BOOL recordNext(RecordReader *reader, GameRecord *game) {
+
+    const uint8_t *h = reader->next;
+
+    if (h == NULL || reader->end -h < kRECORD_HEADER_BYTES) return false;
+
+    int n = h[20];
+    int moveBytes = (n*kRECORD_MOVE_BITS +7)/8;
+
+    if (n > kBOARDS_CELLS || reader->end -h < kRECORD_HEADER_BYTES +moveBytes +n) return false;
+
+    game->players[0] = (char)h[0];
+    game->players[1] = (char)h[1];
+    game->settings[0] = (uint16_t)getLE(h +2, 2);
+    game->settings[1] = (uint16_t)getLE(h +4, 2);
+    game->mistakes[0] = (uint16_t)getLE(h +6, 2);
+    game->mistakes[1] = (uint16_t)getLE(h +8, 2);
+    game->seed = getLE(h +10, 8);
+    game->first = h[18];
+    game->result = h[19];
+    game->nMoves = (uint8_t)n;
+    game->openingMoves = (h[21] <= n ? h[21] : n);
+    game->moves = h +kRECORD_HEADER_BYTES;
+    game->times = game->moves +moveBytes;
+
+    reader->next = game->times +n;
+
+    return true;
+}
+
+#ifdef USE_MMAP
+
+BOOL recordReaderOpen(RecordReader *reader, const char *path) {
+
+    reader->next = NULL;
+    reader->mapping = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return false;
+
+    if (!recordReaderAttach(reader, data, (size_t)st.st_size)) {
+        munmap(data, (size_t)st.st_size);
+        return false;
+    }
+
+    // Read front to back once
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    reader->mapping = data;
+
+    return true;
+}
+
+void recordReaderClose(RecordReader *reader) {
+    if (reader->mapping != NULL) munmap(reader->mapping, reader->length);
+    reader->mapping = NULL;
+    reader->next = NULL;
+}
+
+#endif
+
+// Below 8 us the value itself, else the top 4 bits of it (the first always
+// set, so left out) with the position of the top one.
+uint8_t recordPackMicros(uint32_t micros) {
+
+    if (micros < 8) return (uint8_t)micros;
+
+    int top = 31 -__builtin_clz(micros);
+
+    return (uint8_t)(((top -2) << 3) | ((micros >> (top -3)) & 7));
+}
+
+uint32_t recordUnpackMicros(uint8_t packed) {
+
+    if (packed < 8) return packed;
+
+    int top = (packed >> 3) +2;
+
+    return (uint32_t)(8 | (packed & 7)) << (top -3);
+}
@@ -0,0 +1,101 @@
+#ifndef GAME_RECORD
+#define GAME_RECORD
+
+#include "Constants.h"
+
+// Record file, little endian, written one game at a time and never edited:
+//
+//   RecordFileHeader
+//   per game, kRECORD_HEADER_BYTES of
+//     uint8_t  players[2]      kPLAYER_1, kCPU_HARD, ...
+//     uint16_t settings[2]     search depth of EASY and HARD, time budget in ms of the EXPERT, 0 for people
+//     uint16_t mistakes[2]     a CPU plays a random column once in that many moves, 0 for never
+//     uint64_t seed            the game's random seed
+//     uint8_t  first           index in players of who moved first
+//     uint8_t  result          RecordResult
+//     uint8_t  nMoves
+//     uint8_t  openingMoves    the first moves were set, not played (Tournament openings)
+//   then the columns played, kRECORD_MOVE_BITS each (move i at bit i*bits),
+//   and the think time of every move in one byte (see recordPackMicros()).
+//
+// A game of 30 moves takes 22 +12 +30 bytes.
+
+#define kRECORD_MAGIC       0x52473443      // "C4GR"
+#define kRECORD_VERSION     3
+#define kRECORD_MOVE_BITS   (kBOARDS_COLS <= 8 ? 3 : 4)
+#define kRECORD_HEADER_BYTES 22
+#define kRECORD_MOVE_BYTES  ((kBOARDS_CELLS*kRECORD_MOVE_BITS +7)/8)
+
+typedef enum {
+    RecordResultFirstPlayer,                // players[0] won
+    RecordResultSecondPlayer,
+    RecordResultTie,
+    RecordResultAbandoned
+} RecordResult;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t cols, rows;
+    uint8_t lenToWin;
+    uint8_t moveBits;
+    uint16_t reserved;
+} RecordFileHeader;
+
+// A game as read back. moves and times point into the reader's data.
+typedef struct {
+    char players[2];
+    uint16_t settings[2];
+    uint16_t mistakes[2];
+    uint64_t seed;
+    uint8_t first, result, nMoves, openingMoves;
+    const uint8_t *moves;
+    const uint8_t *times;
+} GameRecord;
+
+// Collects one game's moves, then appends the game with a single write.
+typedef struct {
+    FILE *file;
+    uint8_t bytes[kRECORD_HEADER_BYTES +kRECORD_MOVE_BYTES +kBOARDS_CELLS];
+    int nMoves;
+    uint64_t games;
+} RecordWriter;
+
+typedef struct {
+    const uint8_t *next, *end;
+    void *mapping;                          // Non-NULL when recordReaderOpen() mapped a file
+    size_t length;
+} RecordReader;
+
+// Writes the file header if file is empty, else checks it's a record file
+// of this geometry to append to.
+BOOL recordWriterInit(RecordWriter *writer, FILE *file);
+void recordBegin(RecordWriter *writer, const char players[2], const uint16_t settings[2], const uint16_t mistakes[2], uint64_t seed, int first);
+void recordMove(RecordWriter *writer, int col, uint32_t micros);
+// A move of the opening the game started from, before any recordMove()
+void recordOpeningMove(RecordWriter *writer, int col);
+BOOL recordEnd(RecordWriter *writer, RecordResult result);
+
+// Nothing is copied, so data must outlive the reader.
+BOOL recordReaderAttach(RecordReader *reader, const void *data, size_t length);
+// False at the end of the file, or at a game cut short.
+BOOL recordNext(RecordReader *reader, GameRecord *game);
+
+#ifdef USE_MMAP
+BOOL recordReaderOpen(RecordReader *reader, const char *path);
+void recordReaderClose(RecordReader *reader);
+#endif
+
+// Think times as 8-bit floats: 3 bits of mantissa, to within 12.5%, from
+// 1 us to over an hour.
+uint8_t recordPackMicros(uint32_t micros);
+uint32_t recordUnpackMicros(uint8_t packed);
+
+static inline int recordMoveAt(const GameRecord *game, int i) {
+    int bit = i*kRECORD_MOVE_BITS;
+    uint32_t w = game->moves[bit/8];
+    if (bit%8 +kRECORD_MOVE_BITS > 8) w |= (uint32_t)game->moves[bit/8 +1] << 8;
+    return (w >> (bit%8)) & ((1 << kRECORD_MOVE_BITS) -1);
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef HAL
+#define HAL
+
+#include <stdint.h>
+
+// Everything the game needs from the board goes through here. The ZYBO
+// backend is HAL_Zynq.c. Builds with HOST_BUILD link a stand-in instead
+// (Host_tools/HAL_Linux.c), which also supplies the XTime clock.
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#include <stdlib.h>
+typedef uint64_t XTime;
+#define COUNTS_PER_SECOND   1000000000ULL   // clock_gettime() nanoseconds
+#define xil_printf          printf
+void XTime_GetTime(XTime *xtime);
+#else
+#include "platform.h"
+#include <xgpio.h>
+#include "xparameters.h"
+#include "sleep.h"
+#include "xtime_l.h"
+#endif
+
+// 32-bit words of the shape list scanned out by the VGA controller
+#define kSHAPE_SLOTS        51
+
+#ifndef HOST_BUILD
+// DDR the program leaves alone, at the top of the ZYBO's 512 MB, for files
+// the debugger loads before it runs, e.g. "dow -data book.bin 0x18000000"
+// from xsct. Each file's header tells it from whatever else is there.
+#define kHAL_BOOK_ADDRESS       0x18000000
+#define kHAL_ENDGAME_ADDRESS    0x1C000000
+#define kHAL_PRELOAD_BYTES      0x04000000      // At most, for each file
+#endif
+
+void halInit();
+void halCleanup();
+
+uint32_t halReadButtons();
+uint32_t halReadSwitches();
+void halWriteLEDs(uint32_t leds);
+
+// Calls handler from the GPIO interrupt at every change of the buttons or
+// switches. Returns 0 when there's no interrupt to do it with: the inputs
+// have to be polled then. halMaskInput(1) holds the handler back, for code
+// sharing its state, until halMaskInput(0).
+int halOnInputChange(void (*handler)());
+void halMaskInput(int masked);
+
+// Sleeps until the next interrupt, unless ready() already returns non-zero.
+// ready() is called with interrupts held back, so one coming in just then
+// still wakes the sleep.
+void halSleepUntilInterrupt(int (*ready)());
+
+uint32_t* halShapeBuffer();
+
+// HEADLESS builds never wait: frames and pauses are only there for people
+#ifdef HEADLESS
+#define halSleepMicros(_us) ((void)(_us))
+#else
+void halSleepMicros(uint32_t us);
+#endif
+
+#ifdef HOST_BUILD
+// Simulated devices
+void halSimulateButtons(uint32_t buttons);
+void halSimulateSwitches(uint32_t switches);
+uint32_t halLEDs();
+
+// Scripted device: the file's lines, "ms buttons switches", set the inputs
+// that many ms after halOnInputChange() and interrupt like the board's
+// GPIO. Load it before. halInputOver() is non-zero after the last line.
+int halScriptInput(FILE *script);
+int halInputOver();
+
+// Every shape list flushed from then on is appended to the file, for
+// Host_tools/Render (see halShapesFlushed())
+void halRecordShapes(FILE *file);
+void halShapesFlushed();
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef HOST_BUILD
+
+#include "HAL.h"
+
+// With the GPIO's interrupt wired to the GIC in the hardware design
+#ifdef XPAR_FABRIC_AXI_GPIO_0_IP2INTC_IRPT_INTR
+#include "xscugic.h"
+#include "xil_exception.h"
+
+static XScuGic gic;
+static void (*inputHandler)();
+#endif
+
+static XGpio input, output;
+
+void halInit() {
+    XGpio_Initialize(&input, XPAR_AXI_GPIO_0_DEVICE_ID);
+    XGpio_Initialize(&output, XPAR_AXI_GPIO_1_DEVICE_ID);
+    XGpio_SetDataDirection(&input, 1, 0xF);
+    XGpio_SetDataDirection(&input, 2, 0xF);
+    XGpio_SetDataDirection(&output, 1, 0x0);
+    init_platform();
+}
+
+void halCleanup() {
+    cleanup_platform();
+}
+
+uint32_t halReadButtons() {
+    return XGpio_DiscreteRead(&input, 1);
+}
+
+uint32_t halReadSwitches() {
+    return XGpio_DiscreteRead(&input, 2);
+}
+
+void halWriteLEDs(uint32_t leds) {
+    XGpio_DiscreteWrite(&output, 1, leds);
+}
+
+#ifdef XPAR_FABRIC_AXI_GPIO_0_IP2INTC_IRPT_INTR
+
+static void gpioInterrupt(void *ref) {
+    XGpio_InterruptClear(&input, XGPIO_IR_MASK);
+    inputHandler();
+}
+
+int halOnInputChange(void (*handler)()) {
+
+    XScuGic_Config *config = XScuGic_LookupConfig(XPAR_SCUGIC_SINGLE_DEVICE_ID);
+    if (config == NULL || XScuGic_CfgInitialize(&gic, config, config->CpuBaseAddress) != XST_SUCCESS) return 0;
+
+    inputHandler = handler;
+
+    if (XScuGic_Connect(&gic, XPAR_FABRIC_AXI_GPIO_0_IP2INTC_IRPT_INTR, (Xil_InterruptHandler)gpioInterrupt, NULL) != XST_SUCCESS) return 0;
+    XScuGic_Enable(&gic, XPAR_FABRIC_AXI_GPIO_0_IP2INTC_IRPT_INTR);
+
+    Xil_ExceptionInit();
+    Xil_ExceptionRegisterHandler(XIL_EXCEPTION_ID_INT, (Xil_ExceptionHandler)XScuGic_InterruptHandler, &gic);
+    Xil_ExceptionEnable();
+
+    XGpio_InterruptEnable(&input, XGPIO_IR_CH1_MASK | XGPIO_IR_CH2_MASK);
+    XGpio_InterruptGlobalEnable(&input);
+
+    return 1;
+}
+
+void halMaskInput(int masked) {
+    if (masked) XGpio_InterruptGlobalDisable(&input);
+    else XGpio_InterruptGlobalEnable(&input);
+}
+
+// WFI wakes on a pending interrupt even with exceptions disabled
+void halSleepUntilInterrupt(int (*ready)()) {
+    Xil_ExceptionDisable();
+    if (!ready()) __asm__ volatile ("wfi");
+    Xil_ExceptionEnable();
+}
+
+#else
+
+int halOnInputChange(void (*handler)()) {
+    return 0;
+}
+
+void halMaskInput(int masked) {
+}
+
+void halSleepUntilInterrupt(int (*ready)()) {
+}
+
+#endif
+
+uint32_t* halShapeBuffer() {
+    return (uint32_t *)0x40000000;
+}
+
+#ifndef HEADLESS
+void halSleepMicros(uint32_t us) {
+    usleep(us);
+}
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+#include "Input.h"
+
+// Buttons in bits 0-3 of the lines, switches in bits 4-7
+#define kINPUT_LINES        8
+#define kBUTTON_LINES       0x0F
+
+static InputEvent queue[kINPUT_QUEUE];
+static volatile uint32_t head, tail;    // Read by the game, written by sample()
+static uint32_t lines;                  // Debounced
+static XTime settles[kINPUT_LINES];     // Until then, a line's bounces are ignored
+static BOOL interrupts = false;
+
+static BOOL pending = false;            // An event was answered, not shown yet
+static XTime pendingSince;
+static InputLatency latency;
+
+static void push(InputEventType type, uint32_t changed, XTime now) {
+
+    if (tail -head >= kINPUT_QUEUE) {
+        ++(latency.dropped);
+        return;
+    }
+
+    InputEvent *event = &queue[tail %kINPUT_QUEUE];
+    event->type = type;
+    event->changed = changed;
+    event->buttons = lines & kBUTTON_LINES;
+    event->switches = lines >> 4;
+    event->time = now;
+
+    ++tail;
+}
+
+// From the interrupt, or with it masked
+static void sample() {
+
+    XTime now;
+    XTime_GetTime(&now);
+
+    uint32_t raw = (halReadButtons() & kBUTTON_LINES) | (halReadSwitches() & 0x0F) << 4;
+    uint32_t changed = raw ^ lines, bits;
+    int line;
+
+    for (bits=changed; bits != 0; bits &= bits -1) {
+        line = __builtin_ctz(bits);
+        if (now < settles[line]) changed &= ~(1u << line);
+        else settles[line] = now +(XTime)kINPUT_DEBOUNCE_US*COUNTS_PER_SECOND/1000000;
+    }
+
+    lines ^= changed;
+
+    for (bits=changed & kBUTTON_LINES; bits != 0; bits &= bits -1) {
+        uint32_t button = bits & -bits;
+        push((lines & button ? InputEventButtonDown : InputEventButtonUp), button, now);
+    }
+
+    if (changed >> 4) push(InputEventSwitches, changed >> 4, now);
+}
+
+static void onInputChange() {
+    sample();
+}
+
+// Also catches the lines that settled, after their bounces, in another state
+// than their first edge left them in: that makes no interrupt.
+static void poll() {
+    if (interrupts) halMaskInput(1);
+    sample();
+    if (interrupts) halMaskInput(0);
+}
+
+// With interrupts masked: nothing to wait for, or a line still bouncing that
+// no interrupt may tell about
+static int readyOrSettling() {
+
+    XTime now;
+    int line;
+
+    if (head != tail) return 1;
+
+    XTime_GetTime(&now);
+    for (line=0; line<kINPUT_LINES; ++line) {
+        if (now < settles[line]) return 1;
+    }
+
+    return 0;
+}
+
+void inputInit() {
+
+    head = tail = 0;
+    lines = (halReadButtons() & kBUTTON_LINES) | (halReadSwitches() & 0x0F) << 4;
+
+    interrupts = (halOnInputChange(onInputChange) != 0);
+}
+
+BOOL inputNext(InputEvent *event) {
+
+    poll();
+
+    if (head == tail) return false;
+
+    *event = queue[head %kINPUT_QUEUE];
+    ++head;
+
+    return true;
+}
+
+BOOL inputWait(InputEvent *event, uint32_t timeout_us) {
+
+    XTime start, now;
+    XTime_GetTime(&start);
+
+    while (!inputNext(event)) {
+
+        if (inputOver()) return false;
+
+        XTime_GetTime(&now);
+        if (timeout_us != kINPUT_FOREVER && now -start >= (XTime)timeout_us*COUNTS_PER_SECOND/1000000) return false;
+
+        if (interrupts && timeout_us == kINPUT_FOREVER && !readyOrSettling()) halSleepUntilInterrupt(readyOrSettling);
+        else halSleepMicros(kINPUT_POLL_US);
+    }
+
+    return true;
+}
+
+void inputFlush() {
+    poll();
+    head = tail;
+}
+
+uint32_t inputButtons() {
+    return lines & kBUTTON_LINES;
+}
+
+uint32_t inputSwitches() {
+    return lines >> 4;
+}
+
+BOOL inputOver() {
+#ifdef HOST_BUILD
+    return (halInputOver() && head == tail);
+#else
+    return false;
+#endif
+}
+
+void inputHandled(const InputEvent *event) {
+    if (pending) return;
+    pending = true;
+    pendingSince = event->time;
+}
+
+// The VGA controller shows the words from its next scan, within a frame
+void inputShown() {
+
+    if (!pending) return;
+
+    XTime now;
+    XTime_GetTime(&now);
+
+    uint32_t us = (uint32_t)((now -pendingSince)*1000000 /COUNTS_PER_SECOND);
+
+    ++(latency.count);
+    latency.total_us += us;
+    if (us > latency.max_us) latency.max_us = us;
+
+    pending = false;
+}
+
+const InputLatency* inputLatency() {
+    return &latency;
+}
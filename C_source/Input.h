@@ -0,0 +1,66 @@
+#ifndef INPUT
+#define INPUT
+
+#include "Constants.h"
+
+// Buttons and switches as a queue of debounced, timestamped changes. On the
+// board, the GPIO interrupt samples the inputs at every change, when the
+// design has it wired (see halOnInputChange()); else, and on the host, the
+// calls below sample them, so waiting polls every kINPUT_POLL_US.
+//
+// An input takes effect at its first edge: the bounces that follow within
+// kINPUT_DEBOUNCE_US are ignored, and a state it settles in later is seen
+// at the next sample.
+
+#define kINPUT_QUEUE        32      // Events kept until read, the older ones first
+#define kINPUT_DEBOUNCE_US  10000
+#define kINPUT_POLL_US      1000
+#define kINPUT_FOREVER      0xFFFFFFFF
+
+typedef enum {
+    InputEventButtonDown,
+    InputEventButtonUp,
+    InputEventSwitches
+} InputEventType;
+
+typedef struct {
+    InputEventType type;
+    uint32_t changed;               // The button, or the switches, that changed
+    uint32_t buttons, switches;     // Every input after the change
+    XTime time;                     // Of the first edge
+} InputEvent;
+
+typedef struct {
+    uint32_t count;                 // Events shown
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t dropped;               // Events lost to a full queue
+} InputLatency;
+
+void inputInit();
+
+// The next event, FALSE if none is waiting
+BOOL inputNext(InputEvent *event);
+
+// The next event, waiting for up to timeout_us (or kINPUT_FOREVER) for one.
+// FALSE on timeout, or once inputOver().
+BOOL inputWait(InputEvent *event, uint32_t timeout_us);
+
+// Drops the events waiting: a screen starts from the inputs' state, not
+// from what was pressed before it showed.
+void inputFlush();
+
+// Debounced state
+uint32_t inputButtons();
+uint32_t inputSwitches();
+
+// TRUE once no more input can come, when a host script has run out
+BOOL inputOver();
+
+// Input-to-screen latency: the game marks the event it has drawn the answer
+// to, and the next displayFlush() that writes anything closes it.
+void inputHandled(const InputEvent *event);
+void inputShown();
+const InputLatency* inputLatency();
+
+#endif
@@ -0,0 +1,139 @@
+#include "OpeningBook.h"
+
+#ifdef USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define kCOLUMN_MASK        ((((Bitboard)1) << kBB_HEIGHT) -1)
+
+static Bitboard mirroredBitboard(Bitboard b) {
+    Bitboard m = 0;
+    int c;
+    for (c=0; c<kBOARDS_COLS; ++c) {
+        m |= ((b >> (c*kBB_HEIGHT)) & kCOLUMN_MASK) << ((kBOARDS_COLS -1 -c)*kBB_HEIGHT);
+    }
+    return m;
+}
+
+// discs of the player to move + occupied cells + one bit per column: each
+// column then reads as a 1 above its discs, so the sum tells positions apart
+// without collisions. Unlike the Zobrist key, it doesn't depend on which of
+// the two players[] is which.
+static uint64_t perfectKey(Bitboard mine, Bitboard occupied) {
+    int c;
+    Bitboard bottom = 0;
+    for (c=0; c<kBOARDS_COLS; ++c) bottom |= bitForCell(c, 0);
+    Bitboard key = mine + occupied + bottom;
+#if kBB_CELLS > 64
+    // Folded into 64 bits, so no longer free of collisions on these boards
+    return (uint64_t)key ^ (uint64_t)(key >> 64)*0x9E3779B97F4A7C15ULL;
+#else
+    return key;
+#endif
+}
+
+uint64_t bookKeyForPosition(const Position *pos, int who, BOOL *mirrored) {
+
+    Bitboard occupied = positionOccupied(pos);
+    uint64_t key = perfectKey(pos->discs[who], occupied);
+    uint64_t mirror = perfectKey(mirroredBitboard(pos->discs[who]), mirroredBitboard(occupied));
+
+    if (mirrored != NULL) *mirrored = (mirror < key);
+
+    return (mirror < key ? mirror : key);
+}
+
+// Points the book at data already in memory, e.g. a file loaded into DDR.
+// Nothing is copied, so data must outlive the book.
+BOOL bookAttach(OpeningBook *book, const void *data, size_t length) {
+
+    const BookHeader *header = (const BookHeader *) data;
+
+    book->header = NULL;
+    book->mapping = NULL;
+    book->length = length;
+
+    if (data == NULL || length < sizeof(BookHeader)) return false;
+    if (header->magic != kBOOK_MAGIC || header->version != kBOOK_VERSION) return false;
+    if (header->cols != kBOARDS_COLS || header->rows != kBOARDS_ROWS || header->lenToWin != kLEN_TO_WIN) return false;
+    if (length < sizeof(BookHeader) +(size_t)header->count*(sizeof(uint64_t) +2)) return false;
+
+    book->header = header;
+    book->keys = (const uint64_t *)(header +1);
+    book->moves = (const uint8_t *)(book->keys +header->count);
+    book->scores = (const int8_t *)(book->moves +header->count);
+
+    return true;
+}
+
+// Returns the book column for the player to move, or -1 if the position is
+// not in the book or its entry isn't exact.
+int bookLookup(const OpeningBook *book, const Position *pos, int who, int *score) {
+
+    if (book == NULL || book->header == NULL || pos->nMoves > book->header->plies) return -1;
+
+    BOOL mirrored;
+    uint64_t key = bookKeyForPosition(pos, who, &mirrored);
+
+    uint32_t lo = 0, hi = book->header->count;
+
+    while (lo < hi) {
+        uint32_t mid = lo +(hi -lo)/2;
+        if (book->keys[mid] < key) lo = mid +1;
+        else hi = mid;
+    }
+
+    if (lo >= book->header->count || book->keys[lo] != key) return -1;
+
+    // A 0 searched short of the last disc may be a win or a loss further on
+    if (book->scores[lo] == 0 && book->header->depth < kBOARDS_CELLS -pos->nMoves) return -1;
+
+    int move = book->moves[lo];
+    if (mirrored) move = kBOARDS_COLS -1 -move;
+
+    if (score != NULL) *score = book->scores[lo];
+
+    return move;
+}
+
+#ifdef USE_MMAP
+
+BOOL bookOpen(OpeningBook *book, const char *path) {
+
+    book->header = NULL;
+    book->mapping = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return false;
+
+    if (!bookAttach(book, data, (size_t)st.st_size)) {
+        munmap(data, (size_t)st.st_size);
+        return false;
+    }
+
+    book->mapping = data;
+
+    return true;
+}
+
+void bookClose(OpeningBook *book) {
+    if (book->mapping != NULL) munmap(book->mapping, book->length);
+    book->mapping = NULL;
+    book->header = NULL;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef OPENING_BOOK
+#define OPENING_BOOK
+
+#include "Constants.h"
+#include "Bitboard.h"
+
+// Book file, little endian, used in place (no parsing, no copies):
+//
+//   BookHeader
+//   uint64_t keys[count]       sorted, see bookKeyForPosition()
+//   uint8_t  moves[count]      best column, in the orientation of the key
+//   int8_t   scores[count]     Solver score for the player to move
+//
+// Mirror images share one entry, so the book only holds the smaller key of
+// the two. Only exact entries are used: a score other than 0 is a win or a
+// loss the search proved, a 0 is a tie only if the search reached the end of
+// the game.
+
+#define kBOOK_MAGIC         0x4B423443      // "C4BK"
+#define kBOOK_VERSION       2
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t cols, rows;
+    uint8_t plies;                  // Positions with up to this many discs
+    uint8_t depth;                  // Search depth they were solved to
+    uint8_t lenToWin;
+    uint8_t reserved;
+    uint32_t count;
+    uint32_t padding[2];            // Keeps keys[] 8-byte aligned
+} BookHeader;
+
+typedef struct {
+    const BookHeader *header;
+    const uint64_t *keys;
+    const uint8_t *moves;
+    const int8_t *scores;
+    void *mapping;                  // Non-NULL when bookOpen() mapped a file
+    size_t length;
+} OpeningBook;
+
+uint64_t bookKeyForPosition(const Position *pos, int who, BOOL *mirrored);
+
+BOOL bookAttach(OpeningBook *book, const void *data, size_t length);
+int bookLookup(const OpeningBook *book, const Position *pos, int who, int *score);
+
+#ifdef USE_MMAP
+BOOL bookOpen(OpeningBook *book, const char *path);
+void bookClose(OpeningBook *book);
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef RANDOM
+#define RANDOM
+
+#include "Constants.h"
+
+// splitmix64: every seed, 0 included, gives a full period of 2^64 outputs.
+// The same seed always gives the same sequence, on the board and the host.
+typedef struct {
+    uint64_t state;
+} Random;
+
+static inline void randomSeed(Random *random, uint64_t seed) {
+    random->state = seed;
+}
+
+static inline uint64_t randomNext(Random *random) {
+    uint64_t z = (random->state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) *0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) *0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, n), with a multiply instead of a division
+static inline uint32_t randomBelow(Random *random, uint32_t n) {
+    return (uint32_t)(((randomNext(random) >> 32) *n) >> 32);
+}
+
+#endif
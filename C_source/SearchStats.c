@@ -0,0 +1,144 @@
+#include "SearchStats.h"
+#include <string.h>
+
+#define kLINE_LENGTH        96
+
+void searchCountersAdd(SearchCounters *into, const SearchCounters *from) {
+
+    int i;
+
+    for (i=0; i<=kBOARDS_CELLS; ++i) into->nodes[i] += from->nodes[i];
+
+    into->terminals += from->terminals;
+    into->horizons += from->horizons;
+    into->expanded += from->expanded;
+    into->children += from->children;
+    into->ttProbes += from->ttProbes;
+    into->ttHits += from->ttHits;
+    into->ttCutoffs += from->ttCutoffs;
+    into->endgameHits += from->endgameHits;
+}
+
+// counters may be NULL for moves that weren't searched.
+void searchStatsAddMove(SearchStats *stats, MoveSource source, const SearchCounters *counters, int rootDiscs, uint64_t micros) {
+
+    int i, bucket = 0;
+
+    ++(stats->moves);
+    if (source == MoveSourceBook) ++(stats->bookMoves);
+    if (source == MoveSourceMistake) ++(stats->mistakes);
+    if (source == MoveSourcePonder) ++(stats->ponderMoves);
+
+    stats->totalMicros += micros;
+    if (micros > stats->maxMicros) stats->maxMicros = micros;
+
+    while (bucket < kLATENCY_BUCKETS -1 && (micros >> (bucket +1)) != 0) ++bucket;
+    ++(stats->latency[bucket]);
+
+    if (counters == NULL) return;
+
+    // From discs on the board to plies below the root
+    SearchCounters byPly = *counters;
+    memset(byPly.nodes, 0, sizeof(byPly.nodes));
+    for (i=rootDiscs; i<=kBOARDS_CELLS; ++i) byPly.nodes[i -rootDiscs] = counters->nodes[i];
+
+    searchCountersAdd(&stats->counters, &byPly);
+}
+
+static uint64_t totalNodes(const SearchStats *stats) {
+    uint64_t n = 0;
+    int i;
+    for (i=0; i<=kBOARDS_CELLS; ++i) n += stats->counters.nodes[i];
+    return n;
+}
+
+// Children per expanded node, in hundredths
+static uint64_t branchingX100(const SearchStats *stats) {
+    const SearchCounters *c = &stats->counters;
+    return (c->expanded > 0 ? c->children*100 /c->expanded : 0);
+}
+
+// Deepest ply with any node, to keep the output short
+static int lastPly(const SearchStats *stats) {
+    int i = kBOARDS_CELLS;
+    while (i > 0 && stats->counters.nodes[i] == 0) --i;
+    return i;
+}
+
+void searchStatsPrintJSON(const SearchStats *stats, const char *player) {
+
+    const SearchCounters *c = &stats->counters;
+    char line[kLINE_LENGTH];
+    int i, last = lastPly(stats);
+    uint64_t bf = branchingX100(stats);
+
+    snprintf(line, sizeof(line), "{\"player\": \"%s\", \"moves\": %lu, \"bookMoves\": %lu, \"mistakes\": %lu,\n",
+             player, (unsigned long)stats->moves, (unsigned long)stats->bookMoves, (unsigned long)stats->mistakes);
+    xil_printf("%s", line);
+
+    snprintf(line, sizeof(line), " \"ponderMoves\": %lu,\n", (unsigned long)stats->ponderMoves);
+    xil_printf("%s", line);
+
+    snprintf(line, sizeof(line), " \"nodes\": %llu, \"terminals\": %llu, \"horizons\": %llu,\n",
+             (unsigned long long)totalNodes(stats), (unsigned long long)c->terminals, (unsigned long long)c->horizons);
+    xil_printf("%s", line);
+
+    snprintf(line, sizeof(line), " \"branching\": %llu.%02llu, \"endgameHits\": %llu,\n",
+             (unsigned long long)(bf /100), (unsigned long long)(bf %100), (unsigned long long)c->endgameHits);
+    xil_printf("%s", line);
+
+    snprintf(line, sizeof(line), " \"ttProbes\": %llu, \"ttHits\": %llu, \"ttCutoffs\": %llu,\n",
+             (unsigned long long)c->ttProbes, (unsigned long long)c->ttHits, (unsigned long long)c->ttCutoffs);
+    xil_printf("%s", line);
+
+    snprintf(line, sizeof(line), " \"meanMicros\": %llu, \"maxMicros\": %llu,\n",
+             (unsigned long long)(stats->moves > 0 ? stats->totalMicros /stats->moves : 0), (unsigned long long)stats->maxMicros);
+    xil_printf("%s", line);
+
+    xil_printf(" \"nodesAtPly\": [");
+    for (i=0; i<=last; ++i) {
+        snprintf(line, sizeof(line), "%s%llu", (i > 0 ? ", " : ""), (unsigned long long)c->nodes[i]);
+        xil_printf("%s", line);
+    }
+    xil_printf("],\n");
+
+    // Bucket i starts at 2^i microseconds
+    xil_printf(" \"latencyLog2Micros\": [");
+    for (i=0; i<kLATENCY_BUCKETS; ++i) {
+        snprintf(line, sizeof(line), "%s%lu", (i > 0 ? ", " : ""), (unsigned long)stats->latency[i]);
+        xil_printf("%s", line);
+    }
+    xil_printf("]}");
+}
+
+void searchStatsPrintCSV(const SearchStats *stats, const char *player) {
+
+    const SearchCounters *c = &stats->counters;
+    char line[kLINE_LENGTH];
+    int i, last = lastPly(stats);
+    uint64_t bf = branchingX100(stats);
+
+    const char *names[] = {"moves", "book_moves", "mistakes", "ponder_moves", "nodes", "terminals", "horizons", "endgame_hits",
+                           "tt_probes", "tt_hits", "tt_cutoffs", "mean_us", "max_us"};
+    uint64_t values[] = {stats->moves, stats->bookMoves, stats->mistakes, stats->ponderMoves, totalNodes(stats), c->terminals, c->horizons, c->endgameHits,
+                         c->ttProbes, c->ttHits, c->ttCutoffs,
+                         (stats->moves > 0 ? stats->totalMicros /stats->moves : 0), stats->maxMicros};
+
+    for (i=0; i<(int)(sizeof(values)/sizeof(values[0])); ++i) {
+        snprintf(line, sizeof(line), "%s,%s,%llu\n", player, names[i], (unsigned long long)values[i]);
+        xil_printf("%s", line);
+    }
+
+    snprintf(line, sizeof(line), "%s,branching,%llu.%02llu\n", player, (unsigned long long)(bf /100), (unsigned long long)(bf %100));
+    xil_printf("%s", line);
+
+    for (i=0; i<=last; ++i) {
+        snprintf(line, sizeof(line), "%s,nodes_ply_%d,%llu\n", player, i, (unsigned long long)c->nodes[i]);
+        xil_printf("%s", line);
+    }
+
+    for (i=0; i<kLATENCY_BUCKETS; ++i) {
+        snprintf(line, sizeof(line), "%s,latency_us_below_%lu,%lu\n", player, (unsigned long)2 << i, (unsigned long)stats->latency[i]);
+        xil_printf("%s", line);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SEARCH_STATS
+#define SEARCH_STATS
+
+#include "Constants.h"
+
+// Search instrumentation, compiled in with USE_SEARCH_STATS. Without it the
+// counting macros expand to nothing and the search pays nothing.
+
+// Bucket i counts the moves that took less than 2^(i+1) microseconds, but
+// at least 2^i (bucket 0 from 0)
+#define kLATENCY_BUCKETS    24
+
+typedef enum {
+    MoveSourceSearch,
+    MoveSourceBook,
+    MoveSourceMistake,      // Random column played in demo mode
+    MoveSourcePonder        // Searched while the opponent was thinking
+} MoveSource;
+
+// Counted by a Solver during one search. Nodes are all the positions reached,
+// leaves included, filed by the number of discs on the board and turned into
+// plies from the root by searchStatsAddMove().
+typedef struct {
+    uint64_t nodes[kBOARDS_CELLS +1];
+    uint64_t terminals;     // Wins and full boards reached
+    uint64_t horizons;      // Positions left open at the depth limit
+    uint64_t expanded;      // Nodes whose children were searched...
+    uint64_t children;      // ...and how many
+    uint64_t ttProbes, ttHits, ttCutoffs;
+    uint64_t endgameHits;
+} SearchCounters;
+
+typedef struct {
+    SearchCounters counters;        // nodes[] by ply from the root
+    uint32_t moves, bookMoves, mistakes, ponderMoves;
+    uint64_t totalMicros, maxMicros;
+    uint32_t latency[kLATENCY_BUCKETS];
+} SearchStats;
+
+#ifdef USE_SEARCH_STATS
+#define statsCount(_solver,_field) (++(_solver)->counters._field)
+#define statsCountNode(_solver,_pos) (++(_solver)->counters.nodes[(_pos)->nMoves])
+#else
+#define statsCount(_solver,_field) ((void)0)
+#define statsCountNode(_solver,_pos) ((void)0)
+#endif
+
+void searchCountersAdd(SearchCounters *into, const SearchCounters *from);
+void searchStatsAddMove(SearchStats *stats, MoveSource source, const SearchCounters *counters, int rootDiscs, uint64_t micros);
+
+// One JSON object, or CSV lines of "player,metric,value", through xil_printf
+void searchStatsPrintJSON(const SearchStats *stats, const char *player);
+void searchStatsPrintCSV(const SearchStats *stats, const char *player);
+
+#endif
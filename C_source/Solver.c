@@ -0,0 +1,180 @@
+#include "Solver.h"
+#include <string.h>
+
+#define nextPlayerIndex(_curr) ((_curr+1)%2)
+
+void solverInit(Solver *solver, TranspositionTable *table) {
+    solver->table = table;
+    solver->endgame = NULL;
+    solver->nodes = 0;
+    solver->endgameHits = 0;
+    solver->deadline = 0;
+    solver->aborted = false;
+#ifdef USE_SEARCH_STATS
+    memset(&solver->counters, 0, sizeof(SearchCounters));
+#endif
+}
+
+// Negamax with alpha-beta pruning. Returns the exact score of pos if it lies
+// within (alpha, beta), an upper bound if it is <= alpha, a lower bound if it
+// is >= beta. Positions still open after depth plies score 0.
+int solverNegamax(Solver *solver, Position *pos, int who, int depth, int alpha, int beta) {
+
+    int i;
+
+    ++(solver->nodes);
+    statsCountNode(solver, pos);
+
+    if (solverOutOfTime(solver)) return 0;
+
+    if (pos->nMoves >= kBOARDS_CELLS) {
+        statsCount(solver, terminals);
+        return 0;
+    }
+
+    int value;
+
+    // Close to the end, the table knows the exact answer
+    if (solver->endgame != NULL && endgameProbe(solver->endgame, pos, who, &value)) {
+        ++(solver->endgameHits);
+        statsCount(solver, endgameHits);
+        return value;
+    }
+
+    // A win now beats anything deeper in the tree
+    for (i=0; i<kBOARDS_COLS; ++i) {
+        if (positionCanPlay(pos, i) && positionIsWinningMove(pos, i, who)) {
+            statsCount(solver, terminals);
+            return scoreForWinAt(pos->nMoves);
+        }
+    }
+
+    if (depth <= 0) {
+        statsCount(solver, horizons);
+        return 0;
+    }
+
+    // We can't win with this disc, so at best with the next one
+    int max = scoreForWinAt(pos->nMoves +2);
+    if (beta > max) {
+        beta = max;
+        if (alpha >= beta) return beta;
+    }
+
+    uint64_t key = keyWithSideToMove(pos, who);
+    int bestMove = -1;
+
+    if (solver->table != NULL) {
+
+        TTEntry *entry = ttProbe(solver->table, key);
+        statsCount(solver, ttProbes);
+
+        if (entry != NULL && entry->type != TTValueFitness) {
+
+            value = (int)entry->value;
+
+            // A shallower entry only orders the moves
+            if (entry->depth >= depth) {
+                ttCountHit(solver->table);
+                statsCount(solver, ttHits);
+                if (entry->type == TTValueExact) {
+                    statsCount(solver, ttCutoffs);
+                    return value;
+                }
+                if (entry->type == TTValueLower && value > alpha) alpha = value;
+                if (entry->type == TTValueUpper && value < beta) beta = value;
+                if (alpha >= beta) {
+                    statsCount(solver, ttCutoffs);
+                    return alpha;
+                }
+            }
+
+            bestMove = entry->move;
+        }
+    }
+
+    int alphaOrig = alpha;
+    int best = -kSCORE_INFINITY;
+    int bestCol = -1;
+
+    statsCount(solver, expanded);
+
+    // Previous best move first, then from the center out
+    for (i=-1; i<kBOARDS_COLS; ++i) {
+
+        int col = (i < 0 ? bestMove : columnOrder(i));
+
+        if (col < 0 || col >= kBOARDS_COLS || !positionCanPlay(pos, col)) continue;
+        if (i >= 0 && col == bestMove) continue;
+
+        statsCount(solver, children);
+
+        positionPlay(pos, col, who);
+        int score = -solverNegamax(solver, pos, nextPlayerIndex(who), depth -1, -beta, -alpha);
+        positionUndo(pos, col, who);
+
+        if (solver->aborted) return 0;
+
+        if (score > best) {
+            best = score;
+            bestCol = col;
+        }
+
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+
+    if (solver->table != NULL && depth >= kTT_MIN_DEPTH) {
+
+        TTValueType type = TTValueExact;
+        if (best <= alphaOrig) type = TTValueUpper;
+        else if (best >= beta) type = TTValueLower;
+
+        ttStore(solver->table, key, depth, type, best, bestCol);
+    }
+
+    return best;
+}
+
+// Searches every playable column to depth plies, from the center out, and
+// returns the best one. Ties go to the column closer to the center.
+// Returns -1 if the deadline interrupts the search.
+int solverBestMove(Solver *solver, Position *pos, int who, int depth, int *score) {
+
+    int i;
+    int best = -1;
+    int alpha = -kSCORE_INFINITY;
+
+    statsCountNode(solver, pos);
+    statsCount(solver, expanded);
+
+    for (i=0; i<kBOARDS_COLS; ++i) {
+
+        int col = columnOrder(i);
+
+        if (!positionCanPlay(pos, col)) continue;
+
+        if (positionIsWinningMove(pos, col, who)) {
+            alpha = scoreForWinAt(pos->nMoves);
+            best = col;
+            break;
+        }
+
+        statsCount(solver, children);
+
+        positionPlay(pos, col, who);
+        int value = -solverNegamax(solver, pos, nextPlayerIndex(who), depth -1, -kSCORE_INFINITY, -alpha);
+        positionUndo(pos, col, who);
+
+        if (solver->aborted) return -1;
+
+        if (best == -1 || value > alpha) {
+            alpha = value;
+            best = col;
+        }
+    }
+
+    if (score != NULL) *score = alpha;
+
+    return best;
+}
@@ -0,0 +1,51 @@
+#ifndef SOLVER
+#define SOLVER
+
+#include "Constants.h"
+#include "Bitboard.h"
+#include "TranspositionTable.h"
+#include "EndgameTable.h"
+#include "SearchStats.h"
+
+// Scores are from the point of view of the player to move: a win with the
+// k-th disc of a player scores (kBOARDS_CELLS/2 +1 -k), so the sooner the
+// better. Ties score 0, losses are the negated wins of the opponent.
+#define kSCORE_WIN_MAX      ((kBOARDS_CELLS +1)/2)
+#define kSCORE_INFINITY     (kSCORE_WIN_MAX +1)
+
+#define scoreForWinAt(_nMoves) ((kBOARDS_CELLS +1 -(_nMoves))/2)
+
+typedef struct {
+    TranspositionTable *table;      // May be NULL
+    const EndgameTable *endgame;    // May be NULL
+    uint64_t nodes;
+    uint64_t endgameHits;
+    XTime deadline;                 // 0 for no time limit
+    BOOL aborted;                   // Set once the deadline has passed
+#ifdef USE_SEARCH_STATS
+    SearchCounters counters;
+#endif
+} Solver;
+
+// Center columns first: they take part in the most lines, so they are the
+// likeliest to raise alpha early and cut the remaining siblings. A constant
+// expression, so unrolled loops over it cost no lookups.
+#define columnOrder(_i) (kBOARDS_COLS/2 +(1 -2*((_i)%2))*((_i)+1)/2)
+
+void solverInit(Solver *solver, TranspositionTable *table);
+
+// Polls the clock every 1024 nodes once a deadline is set. Results computed
+// after this returns true are meaningless and must be thrown away.
+static inline BOOL solverOutOfTime(Solver *solver) {
+    if (solver->deadline != 0 && !solver->aborted && (solver->nodes & 1023) == 0) {
+        XTime now;
+        XTime_GetTime(&now);
+        if (now >= solver->deadline) solver->aborted = true;
+    }
+    return solver->aborted;
+}
+
+int solverNegamax(Solver *solver, Position *pos, int who, int depth, int alpha, int beta);
+int solverBestMove(Solver *solver, Position *pos, int who, int depth, int *score);
+
+#endif
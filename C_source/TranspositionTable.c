@@ -0,0 +1,114 @@
+#include "TranspositionTable.h"
+#include <string.h>
+
+#define slotForKey(_tt,_key) (&(_tt)->entries[(uint32_t)(_key) & (_tt)->mask])
+#define lockForKey(_key) ((uint32_t)((_key) >> 32))
+
+static void ttSetEntries(TranspositionTable *tt, TTEntry *entries, size_t n, BOOL owned);
+
+// Rounds the budget down to a power of two number of entries.
+size_t ttFootprint(size_t bytes) {
+
+    size_t n = 1;
+    while (n*2*sizeof(TTEntry) <= bytes) n *= 2;
+
+    return n*sizeof(TTEntry);
+}
+
+BOOL ttInit(TranspositionTable *tt, size_t bytes) {
+    size_t size = ttFootprint(bytes);
+    ttSetEntries(tt, (TTEntry *) malloc(size), size/sizeof(TTEntry), true);
+    return tt->entries != NULL;
+}
+
+BOOL ttInitInArena(TranspositionTable *tt, Arena *arena, size_t bytes) {
+    size_t size = ttFootprint(bytes);
+    ttSetEntries(tt, (TTEntry *) arenaAlloc(arena, size), size/sizeof(TTEntry), false);
+    return tt->entries != NULL;
+}
+
+void ttFree(TranspositionTable *tt) {
+    if (tt->entries != NULL && tt->ownsEntries) free(tt->entries);
+    tt->entries = NULL;
+    tt->mask = 0;
+}
+
+static void ttSetEntries(TranspositionTable *tt, TTEntry *entries, size_t n, BOOL owned) {
+
+    tt->entries = entries;
+    tt->ownsEntries = owned;
+
+    if (tt->entries == NULL) {
+        tt->mask = 0;
+        return;
+    }
+
+    tt->mask = (uint32_t)(n -1);
+    ttClear(tt);
+}
+
+void ttClear(TranspositionTable *tt) {
+    memset(tt->entries, 0, ((size_t)tt->mask +1)*sizeof(TTEntry));
+    tt->generation = 1;
+    ttResetCounters(tt);
+}
+
+// Ages every stored entry by one search. Entries from older searches are the
+// first to be replaced.
+void ttNewSearch(TranspositionTable *tt) {
+    if (++(tt->generation) == 0) {
+        // Wrapped around: old entries would look fresh again
+        ttClear(tt);
+    }
+}
+
+void ttResetCounters(TranspositionTable *tt) {
+    tt->hits = 0;
+    tt->misses = 0;
+    tt->collisions = 0;
+}
+
+TTEntry* ttProbe(TranspositionTable *tt, uint64_t key) {
+
+    TTEntry *e = slotForKey(tt, key);
+
+    if (e->type == TTValueNone) {
+        ++(tt->misses);
+        return NULL;
+    }
+
+    if (e->lock != lockForKey(key)) {
+        ++(tt->misses);
+        ++(tt->collisions);
+        return NULL;
+    }
+
+    if (e->type == TTValueFitness && e->generation != tt->generation) {
+        ++(tt->misses);
+        return NULL;
+    }
+
+    return e;
+}
+
+void ttCountHit(TranspositionTable *tt) {
+    ++(tt->hits);
+}
+
+// Keeps the deeper of the two results, unless the one in the slot is from an
+// earlier search.
+void ttStore(TranspositionTable *tt, uint64_t key, int depth, TTValueType type, double value, int move) {
+
+    TTEntry *e = slotForKey(tt, key);
+
+    if (e->type != TTValueNone && e->generation == tt->generation && e->depth > depth) {
+        return;
+    }
+
+    e->lock = lockForKey(key);
+    e->depth = (int8_t)depth;
+    e->type = (uint8_t)type;
+    e->generation = tt->generation;
+    e->move = (uint8_t)move;
+    e->value = value;
+}
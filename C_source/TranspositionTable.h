@@ -0,0 +1,53 @@
+#ifndef TRANSPOSITION_TABLE
+#define TRANSPOSITION_TABLE
+
+#include "Constants.h"
+#include "Arena.h"
+
+#define kTT_DEFAULT_BYTES   (2*1024*1024)
+
+// Subtrees shallower than this are cheaper to search than to look up
+#define kTT_MIN_DEPTH       2
+
+typedef enum {
+    TTValueNone,
+    TTValueFitness,     // Sum of traverse() weights, only valid in the search that stored it
+    TTValueExact,       // Negamax scores, valid across searches
+    TTValueLower,
+    TTValueUpper
+} TTValueType;
+
+typedef struct {
+    uint32_t lock;          // Upper half of the key, to tell positions sharing a slot apart
+    int8_t depth;           // Remaining depth the value was searched to
+    uint8_t type;           // TTValueType
+    uint8_t generation;     // Search that stored the entry
+    uint8_t move;
+    double value;
+} TTEntry;
+
+typedef struct {
+    TTEntry *entries;
+    BOOL ownsEntries;       // Else they belong to an arena
+    uint32_t mask;          // Number of entries -1 (always a power of two)
+    uint8_t generation;
+    uint64_t hits;          // Entries the search used, see ttCountHit()
+    uint64_t misses;        // Probes that found no entry for the key...
+    uint64_t collisions;    // ...some of them because another key held the slot
+} TranspositionTable;
+
+BOOL ttInit(TranspositionTable *tt, size_t bytes);
+BOOL ttInitInArena(TranspositionTable *tt, Arena *arena, size_t bytes);
+size_t ttFootprint(size_t bytes);   // Bytes a table of this budget takes
+void ttFree(TranspositionTable *tt);
+void ttClear(TranspositionTable *tt);
+void ttNewSearch(TranspositionTable *tt);
+void ttResetCounters(TranspositionTable *tt);
+
+// The entry stored for key, if any. It may still be too shallow, or of the
+// wrong kind, for the caller, which calls ttCountHit() when it uses it.
+TTEntry* ttProbe(TranspositionTable *tt, uint64_t key);
+void ttCountHit(TranspositionTable *tt);
+void ttStore(TranspositionTable *tt, uint64_t key, int depth, TTValueType type, double value, int move);
+
+#endif
@@ -0,0 +1,96 @@
+#include "WinTracker.h"
+#include <string.h>
+
+#define trackerCell(_col,_rowFromBottom) ((_col)*kBOARDS_ROWS + (_rowFromBottom))
+
+// Cells of each line, and lines through each cell. Depend on the geometry
+// only, so they are filled once.
+static uint8_t lineCells[kWIN_LINES][kLEN_TO_WIN];
+static uint16_t cellLines[kBOARDS_CELLS][kMAX_LINES_PER_CELL];
+static uint8_t cellLineCount[kBOARDS_CELLS];
+
+static void initWinLines() {
+    static BOOL ready = false;
+    if (ready) return;
+
+    // Up, right, up-right, down-right
+    const int dCol[4] = {0, 1, 1, 1};
+    const int dRow[4] = {1, 0, 1, -1};
+    int d, col, row, s, n = 0;
+
+    memset(cellLineCount, 0, sizeof(cellLineCount));
+
+    for (d=0; d<4; ++d) {
+        for (col=0; col<kBOARDS_COLS; ++col) {
+            for (row=0; row<kBOARDS_ROWS; ++row) {
+
+                int endCol = col +dCol[d]*(kLEN_TO_WIN -1);
+                int endRow = row +dRow[d]*(kLEN_TO_WIN -1);
+                if (endCol >= kBOARDS_COLS || endRow < 0 || endRow >= kBOARDS_ROWS) continue;
+
+                for (s=0; s<kLEN_TO_WIN; ++s) {
+                    int cell = trackerCell(col +dCol[d]*s, row +dRow[d]*s);
+                    lineCells[n][s] = (uint8_t)cell;
+                    cellLines[cell][cellLineCount[cell]++] = (uint16_t)n;
+                }
+                ++n;
+            }
+        }
+    }
+
+    ready = true;
+}
+
+void winTrackerReset(WinTracker *tracker) {
+    initWinLines();
+    memset(tracker->counts, 0, sizeof(tracker->counts));
+    tracker->winner = -1;
+    tracker->winningLine = -1;
+}
+
+BOOL winTrackerPlay(WinTracker *tracker, int col, int rowFromBottom, int who) {
+
+    int cell = trackerCell(col, rowFromBottom);
+    int i;
+
+    for (i=0; i<cellLineCount[cell]; ++i) {
+
+        int line = cellLines[cell][i];
+
+        if (++(tracker->counts[who][line]) == kLEN_TO_WIN && tracker->winner == -1) {
+            tracker->winner = who;
+            tracker->winningLine = line;
+        }
+    }
+
+    return (tracker->winner == who);
+}
+
+void winTrackerUndo(WinTracker *tracker, int col, int rowFromBottom, int who) {
+
+    int cell = trackerCell(col, rowFromBottom);
+    int i;
+
+    for (i=0; i<cellLineCount[cell]; ++i) {
+        --(tracker->counts[who][cellLines[cell][i]]);
+    }
+
+    // Only the last disc can have completed the line
+    if (tracker->winner == who && tracker->counts[who][tracker->winningLine] < kLEN_TO_WIN) {
+        tracker->winner = -1;
+        tracker->winningLine = -1;
+    }
+}
+
+void winTrackerCells(const WinTracker *tracker, uint8_t cells[2][kLEN_TO_WIN]) {
+
+    int s;
+
+    if (tracker->winningLine < 0) return;
+
+    for (s=0; s<kLEN_TO_WIN; ++s) {
+        int cell = lineCells[tracker->winningLine][s];
+        cells[0][s] = (uint8_t)(cell /kBOARDS_ROWS);
+        cells[1][s] = (uint8_t)(kBOARDS_ROWS -1 -cell %kBOARDS_ROWS);
+    }
+}
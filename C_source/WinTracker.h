@@ -0,0 +1,34 @@
+#ifndef WIN_TRACKER
+#define WIN_TRACKER
+
+#include "Constants.h"
+
+// Keeps, for every line of kLEN_TO_WIN cells on the board, how many discs
+// each player has on it. A disc only updates the lines through its cell, so
+// a win is found, with its cells, without scanning the board.
+
+#define kWIN_LINES          ((kBOARDS_COLS -kLEN_TO_WIN +1)*kBOARDS_ROWS \
+                            +kBOARDS_COLS*(kBOARDS_ROWS -kLEN_TO_WIN +1) \
+                            +2*(kBOARDS_COLS -kLEN_TO_WIN +1)*(kBOARDS_ROWS -kLEN_TO_WIN +1))
+
+// One per direction and position of the cell along the line
+#define kMAX_LINES_PER_CELL (4*kLEN_TO_WIN)
+
+typedef struct {
+    uint8_t counts[2][kWIN_LINES];  // counts[who][line]
+    int winner;                     // Index in players[], -1 while nobody has won
+    int winningLine;
+} WinTracker;
+
+void winTrackerReset(WinTracker *tracker);
+
+// Adds a disc of players[who] at col, row (counted from the bottom).
+// Returns true if it completes a line.
+BOOL winTrackerPlay(WinTracker *tracker, int col, int rowFromBottom, int who);
+void winTrackerUndo(WinTracker *tracker, int col, int rowFromBottom, int who);
+
+// Cells of the winning line, in the layout of Board.winningCells: columns in
+// cells[0], rows counted from the top in cells[1].
+void winTrackerCells(const WinTracker *tracker, uint8_t cells[2][kLEN_TO_WIN]);
+
+#endif
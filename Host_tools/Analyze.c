@@ -0,0 +1,328 @@
+// Scores every column of a stream of positions. Reads one position per line,
+// as the columns played from 1 (the first field of a position set will do),
+// from a file or stdin, and prints for each:
+//
+//   moves best_column score score_of_column_1 ... score_of_column_n
+//
+// with the solver's scores (see Solver.h), "." for full columns, or
+// "moves invalid". -d limits the search to that many plies, past which
+// open positions score 0.
+//
+// Parsing, searching and printing run on their own threads, over batches
+// of kBATCH_POSITIONS lines; -j sets the searching threads, each with its
+// own table of -m MB. Every position starts from an empty table unless -w
+// keeps it warm: the scores are the same, but consecutive positions of one
+// game share most of their subtrees, so the search gets much faster, and
+// the table isn't cleared for every position. For endgames, that clearing
+// can take longer than the search: -m 0 searches without a table.
+//
+//   Analyze [-j threads] [-m table_MB] [-d depth] [-w] [-x endgame.bin] [positions]
+
+#include "Solver.h"
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define nextPlayerIndex(_curr) ((_curr+1)%2)
+
+#define kBATCH_POSITIONS    256
+#define kMAX_THREADS        64
+
+typedef enum {
+    BatchFree,
+    BatchParsed,                    // Waiting for a searching thread
+    BatchSearching,
+    BatchSolved                     // Waiting to be printed
+} BatchState;
+
+typedef struct {
+    BatchState state;
+    int count;
+    char moves[kBATCH_POSITIONS][kBOARDS_CELLS +1];
+    Position positions[kBATCH_POSITIONS];
+    BOOL valid[kBATCH_POSITIONS];
+    int8_t scores[kBATCH_POSITIONS][kBOARDS_COLS];
+    int8_t best[kBATCH_POSITIONS];
+} Batch;
+
+static Batch *batches;
+static int nBatches;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static uint64_t parsedBatches, searchedBatches;
+static BOOL inputOver = false;
+
+static int maxDepth = kBOARDS_CELLS;
+static BOOL warm = false;
+static size_t tableMB = kTT_DEFAULT_BYTES/(1024*1024);
+static const EndgameTable *endgame = NULL;
+static uint64_t totalNodes = 0, totalPositions = 0;
+
+static void* parseMain(void *arg);
+static void* searchMain(void *arg);
+static void* printMain(void *arg);
+static BOOL positionFromMoves(Position *pos, const char *moves);
+static void scoreColumns(Solver *solver, Position *pos, int8_t scores[], int8_t *best);
+
+int main(int argc, char *argv[]) {
+
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN), i;
+    const char *endgamePath = NULL;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0 && i+1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i+1 < argc) tableMB = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0 && i+1 < argc) maxDepth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-w") == 0) warm = true;
+        else if (strcmp(argv[i], "-x") == 0 && i+1 < argc) endgamePath = argv[++i];
+        else break;
+    }
+
+    if (i < argc -1 || threads < 1 || threads > kMAX_THREADS || maxDepth < 1 || (i < argc && argv[i][0] == '-' && argv[i][1] != '\0')) {
+        fprintf(stderr, "usage: %s [-j threads] [-m table_MB] [-d depth] [-w] [-x endgame.bin] [positions]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = (i < argc && strcmp(argv[i], "-") != 0 ? fopen(argv[i], "r") : stdin);
+    if (in == NULL) {
+        perror(argv[i]);
+        return 1;
+    }
+
+    if (endgamePath != NULL) {
+#ifdef USE_MMAP
+        static EndgameTable table;
+        if (!endgameOpen(&table, endgamePath)) {
+            fprintf(stderr, "can't open %s\n", endgamePath);
+            return 1;
+        }
+        endgame = &table;
+#else
+        fprintf(stderr, "endgame tables need a build with USE_MMAP\n");
+        return 1;
+#endif
+    }
+
+    initZobristKeys();
+
+    // One batch being parsed, one being printed, one per searching thread and
+    // one more to keep every stage busy
+    nBatches = threads +3;
+    batches = (Batch *) calloc(nBatches, sizeof(Batch));
+    if (batches == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    XTime tStart, tEnd;
+    pthread_t parser, printer, searchers[kMAX_THREADS];
+
+    XTime_GetTime(&tStart);
+
+    pthread_create(&parser, NULL, parseMain, in);
+    pthread_create(&printer, NULL, printMain, NULL);
+    for (i=0; i<threads; ++i) pthread_create(&searchers[i], NULL, searchMain, NULL);
+
+    pthread_join(parser, NULL);
+    for (i=0; i<threads; ++i) pthread_join(searchers[i], NULL);
+    pthread_join(printer, NULL);
+
+    XTime_GetTime(&tEnd);
+
+    double seconds = (double)(tEnd -tStart) /COUNTS_PER_SECOND;
+    fprintf(stderr, "%llu positions, %llu nodes in %.3f s: %.0f positions/s\n", (unsigned long long)totalPositions,
+            (unsigned long long)totalNodes, seconds, (seconds > 0 ? totalPositions /seconds : 0));
+
+    if (in != stdin) fclose(in);
+
+    return 0;
+}
+
+static void* parseMain(void *arg) {
+
+    FILE *in = (FILE *)arg;
+    char line[256];
+    BOOL more = true;
+
+    while (more) {
+
+        pthread_mutex_lock(&lock);
+        Batch *batch = &batches[parsedBatches %nBatches];
+        while (batch->state != BatchFree) pthread_cond_wait(&changed, &lock);
+        pthread_mutex_unlock(&lock);
+
+        batch->count = 0;
+
+        while (batch->count < kBATCH_POSITIONS && (more = (fgets(line, sizeof(line), in) != NULL))) {
+
+            int n = (int)strcspn(line, " \t\r\n");
+            if (n == 0 || line[0] == '#') continue;
+
+            int p = batch->count++;
+            line[n] = '\0';
+            batch->valid[p] = (n <= kBOARDS_CELLS && positionFromMoves(&batch->positions[p], line));
+            snprintf(batch->moves[p], sizeof(batch->moves[p]), "%s", line);
+        }
+
+        pthread_mutex_lock(&lock);
+        if (batch->count > 0) {
+            ++parsedBatches;
+            batch->state = BatchParsed;
+        }
+        if (!more) inputOver = true;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+
+    return NULL;
+}
+
+static void* searchMain(void *arg) {
+
+    TranspositionTable table;
+    Solver solver;
+    uint64_t nodes = 0;
+    int p;
+
+    if (tableMB > 0 && !ttInit(&table, tableMB*1024*1024)) {
+        fprintf(stderr, "can't allocate %u MB of table\n", (unsigned)tableMB);
+        exit(1);
+    }
+
+    solverInit(&solver, (tableMB > 0 ? &table : NULL));
+    solver.endgame = endgame;
+
+    while (true) {
+
+        // The oldest batch waiting
+        pthread_mutex_lock(&lock);
+        while (!(searchedBatches < parsedBatches && batches[searchedBatches %nBatches].state == BatchParsed) &&
+               !(inputOver && searchedBatches == parsedBatches)) {
+            pthread_cond_wait(&changed, &lock);
+        }
+        if (searchedBatches == parsedBatches) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        Batch *batch = &batches[searchedBatches++ %nBatches];
+        batch->state = BatchSearching;
+        pthread_mutex_unlock(&lock);
+
+        for (p=0; p<batch->count; ++p) {
+            if (!batch->valid[p]) continue;
+            if (!warm && tableMB > 0) ttClear(&table);
+            solver.nodes = 0;
+            scoreColumns(&solver, &batch->positions[p], batch->scores[p], &batch->best[p]);
+            nodes += solver.nodes;
+        }
+
+        pthread_mutex_lock(&lock);
+        batch->state = BatchSolved;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+
+    if (tableMB > 0) ttFree(&table);
+
+    pthread_mutex_lock(&lock);
+    totalNodes += nodes;
+    pthread_mutex_unlock(&lock);
+
+    return NULL;
+}
+
+static void* printMain(void *arg) {
+
+    static char out[kBATCH_POSITIONS*(kBOARDS_CELLS +8 +4*kBOARDS_COLS) +1];
+    uint64_t printed = 0;
+    int p, col;
+
+    while (true) {
+
+        pthread_mutex_lock(&lock);
+        Batch *batch = &batches[printed %nBatches];
+        while (!(printed < parsedBatches && batch->state == BatchSolved) && !(inputOver && printed == parsedBatches)) {
+            pthread_cond_wait(&changed, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+
+        if (printed == parsedBatches) break;
+
+        char *o = out;
+
+        for (p=0; p<batch->count; ++p) {
+
+            o += sprintf(o, "%s", batch->moves[p]);
+
+            if (!batch->valid[p]) {
+                o += sprintf(o, " invalid\n");
+                continue;
+            }
+
+            o += sprintf(o, " %d %d", batch->best[p] +1, batch->scores[p][batch->best[p]]);
+            for (col=0; col<kBOARDS_COLS; ++col) {
+                if (positionCanPlay(&batch->positions[p], col)) o += sprintf(o, " %d", batch->scores[p][col]);
+                else o += sprintf(o, " .");
+            }
+            *o++ = '\n';
+        }
+
+        fwrite(out, 1, o -out, stdout);
+        totalPositions += batch->count;
+
+        pthread_mutex_lock(&lock);
+        batch->state = BatchFree;
+        ++printed;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+
+    fflush(stdout);
+
+    return NULL;
+}
+
+static BOOL positionFromMoves(Position *pos, const char *moves) {
+
+    int who = 0;
+
+    memset(pos, 0, sizeof(Position));
+    if (strlen(moves) >= kBOARDS_CELLS) return false;
+
+    for (; *moves != '\0'; ++moves) {
+        int col = *moves -'1';
+        if (col < 0 || col >= kBOARDS_COLS || !positionCanPlay(pos, col) || positionIsWinningMove(pos, col, who)) return false;
+        positionPlay(pos, col, who);
+        who = nextPlayerIndex(who);
+    }
+
+    return (pos->nMoves < kBOARDS_CELLS);
+}
+
+// Exact score of every playable column, from the center out, and the first
+// best of them.
+static void scoreColumns(Solver *solver, Position *pos, int8_t scores[], int8_t *best) {
+
+    int who = pos->nMoves%2, i;
+    int max = -kSCORE_INFINITY;
+
+    for (i=0; i<kBOARDS_COLS; ++i) {
+
+        int col = columnOrder(i);
+
+        if (!positionCanPlay(pos, col)) continue;
+
+        if (positionIsWinningMove(pos, col, who)) {
+            scores[col] = scoreForWinAt(pos->nMoves);
+        } else {
+            positionPlay(pos, col, who);
+            scores[col] = -solverNegamax(solver, pos, nextPlayerIndex(who), maxDepth -1, -kSCORE_INFINITY, kSCORE_INFINITY);
+            positionUndo(pos, col, who);
+        }
+
+        if (scores[col] > max) {
+            max = scores[col];
+            *best = col;
+        }
+    }
+}
@@ -0,0 +1,510 @@
+// Runs the CPU players over sets of positions with known solutions and
+// prints, for each engine and set, one CSV line with the nodes searched,
+// nodes per second, mean and 99th percentile time per position, and how
+// many answers were correct. Keep the output of two builds and diff them.
+//
+//   Benchmark [-e engine]... [-t expert_ms] [-j threads] [-m table_MB]
+//             [-B batch] [-b book.bin] [-x endgame.bin] set.txt...
+//   Benchmark -g count -p min:max [-s seed] > set.txt
+//
+// Engines are easy, hard and expert, as played by CPUsChoice*(), and solver,
+// the exact solve used to write the sets. The default is all of them. With
+// -B, easy and hard answer batch positions per CPUsChoices() call, and each
+// position is timed as its share of the batch.
+//
+// A set file has one position per line: the columns played so far, from 1,
+// then the score of the player to move (see Solver.h) and every column that
+// achieves it. Lines starting with # are comments. The set is named after
+// the file. The second form writes a set of random positions with min to
+// max discs, solved to the end.
+
+#include "AI.h"
+#include "Solver.h"
+#include <string.h>
+
+#define nextPlayerIndex(_curr) ((_curr+1)%2)
+
+#define kMAX_ENGINES        4
+
+// Moves are written one digit per column
+#if kBOARDS_COLS > 9
+#error "Position sets need boards of at most 9 columns"
+#endif
+
+typedef enum {
+    EngineEasy,
+    EngineHard,
+    EngineExpert,
+    EngineSolver
+} Engine;
+
+static const char *engineNames[kMAX_ENGINES] = {"easy", "hard", "expert", "solver"};
+
+typedef struct {
+    char moves[64];
+    int score;
+    char best[16];                  // Columns from 1, as in the file
+} TestPosition;
+
+typedef struct {
+    uint32_t positions, correct;
+    uint64_t nodes;
+    double *ms;                     // Time of each position
+} Result;
+
+static TranspositionTable solverTable;
+static const EndgameTable *endgame = NULL;
+static uint32_t expertMs = kCPU_EXPERT_TIME_MS;
+static int batchSize = 1;
+
+static int generate(int count, int minDiscs, int maxDiscs, uint64_t seed);
+static TestPosition* loadSet(const char *path, uint32_t *count);
+static BOOL positionFromMoves(Position *pos, const char *moves);
+static void boardFromPosition(Board *board, const Position *pos, const char players[]);
+static int solveColumns(Position *pos, int who, char *best);
+static void runEngine(Engine engine, TestPosition *set, uint32_t count, Result *result);
+static void runEngineBatched(Engine engine, TestPosition *set, uint32_t count, Result *result);
+static void judgeMove(Engine engine, const TestPosition *test, int move, int score, Result *result);
+static void printResult(Engine engine, const char *setName, Result *result);
+static int compareTimes(const void *a, const void *b);
+
+int main(int argc, char *argv[]) {
+
+    BOOL engines[kMAX_ENGINES] = {false};
+    BOOL anyEngine = false;
+    int genCount = 0, genMin = 0, genMax = -1;
+    uint64_t seed = 1;
+    size_t tableMB = 64;
+    const char *bookPath = NULL, *endgamePath = NULL;
+    int i, e, firstSet = argc;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-e") == 0 && i+1 < argc) {
+            ++i;
+            for (e=0; e<kMAX_ENGINES && strcmp(argv[i], engineNames[e]) != 0; ++e);
+            if (e == kMAX_ENGINES) break;
+            engines[e] = true;
+            anyEngine = true;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i+1 < argc) expertMs = (uint32_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) setCPUsThreads(atoi(argv[++i]));
+        else if (strcmp(argv[i], "-m") == 0 && i+1 < argc) tableMB = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-B") == 0 && i+1 < argc) batchSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) bookPath = argv[++i];
+        else if (strcmp(argv[i], "-x") == 0 && i+1 < argc) endgamePath = argv[++i];
+        else if (strcmp(argv[i], "-g") == 0 && i+1 < argc) genCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && i+1 < argc) sscanf(argv[++i], "%d:%d", &genMin, &genMax);
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (argv[i][0] != '-') {
+            firstSet = i;
+            break;
+        }
+        else break;
+    }
+
+    initZobristKeys();
+    CPUsReserve();
+
+    if (!ttInit(&solverTable, tableMB*1024*1024)) {
+        fprintf(stderr, "can't allocate %u MB of table\n", (unsigned)tableMB);
+        return 1;
+    }
+
+    if (genCount > 0 && genMin >= 0 && genMin <= genMax && genMax < kBOARDS_CELLS) {
+        return generate(genCount, genMin, genMax, seed);
+    }
+
+    if (genCount > 0 || firstSet == argc || (i < argc && i != firstSet) || batchSize < 1) {
+        fprintf(stderr, "usage: %s [-e easy|hard|expert|solver]... [-t expert_ms] [-j threads] [-m table_MB] [-B batch] [-b book.bin] [-x endgame.bin] set.txt...\n", argv[0]);
+        fprintf(stderr, "       %s -g count -p min:max [-s seed] > set.txt\n", argv[0]);
+        return 1;
+    }
+
+    if (!anyEngine) {
+        for (e=0; e<kMAX_ENGINES; ++e) engines[e] = true;
+    }
+
+#ifdef USE_MMAP
+    static OpeningBook book;
+    static EndgameTable table;
+
+    if (bookPath != NULL) {
+        if (!bookOpen(&book, bookPath)) {
+            fprintf(stderr, "can't open %s\n", bookPath);
+            return 1;
+        }
+        setCPUsOpeningBook(&book);
+    }
+
+    if (endgamePath != NULL) {
+        if (!endgameOpen(&table, endgamePath)) {
+            fprintf(stderr, "can't open %s\n", endgamePath);
+            return 1;
+        }
+        endgame = &table;
+        setCPUsEndgameTable(endgame);
+    }
+#else
+    if (bookPath != NULL || endgamePath != NULL) {
+        fprintf(stderr, "books and endgame tables need a build with USE_MMAP\n");
+        return 1;
+    }
+#endif
+
+    printf("engine,set,positions,correct,nodes,nodes_per_sec,mean_ms,p99_ms,max_ms\n");
+
+    for (i=firstSet; i<argc; ++i) {
+
+        uint32_t count;
+        TestPosition *set = loadSet(argv[i], &count);
+
+        if (set == NULL) {
+            fprintf(stderr, "can't read %s\n", argv[i]);
+            return 1;
+        }
+
+        // The set is named after the file, without directory and extension
+        char setName[64];
+        const char *base = strrchr(argv[i], '/');
+        snprintf(setName, sizeof(setName), "%s", (base != NULL ? base +1 : argv[i]));
+        char *dot = strrchr(setName, '.');
+        if (dot != NULL) *dot = '\0';
+
+        for (e=0; e<kMAX_ENGINES; ++e) {
+
+            if (!engines[e]) continue;
+
+            Result result;
+            result.ms = (double *) malloc((count > 0 ? count : 1)*sizeof(double));
+
+            runEngine((Engine)e, set, count, &result);
+            printResult((Engine)e, setName, &result);
+            fflush(stdout);
+
+            free(result.ms);
+        }
+
+        free(set);
+    }
+
+    ttFree(&solverTable);
+
+    return 0;
+}
+
+// Plays random moves that don't win on the spot, then solves the position.
+static int generate(int count, int minDiscs, int maxDiscs, uint64_t seed) {
+
+    uint64_t x = seed*0x9E3779B97F4A7C15ULL | 1;
+    int n = 0;
+
+    printf("# %d positions with %d to %d discs, seed %llu\n", count, minDiscs, maxDiscs, (unsigned long long)seed);
+    printf("# moves score best_columns\n");
+
+    while (n < count) {
+
+        Position pos;
+        char moves[kBOARDS_CELLS +1];
+        char best[kBOARDS_COLS +1];
+        int who = 0, col, options[kBOARDS_COLS];
+
+        memset(&pos, 0, sizeof(pos));
+
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        int discs = minDiscs +(int)(x % (uint64_t)(maxDiscs -minDiscs +1));
+
+        while (pos.nMoves < discs) {
+
+            int nOptions = 0;
+            for (col=0; col<kBOARDS_COLS; ++col) {
+                if (positionCanPlay(&pos, col) && !positionIsWinningMove(&pos, col, who)) options[nOptions++] = col;
+            }
+            if (nOptions == 0) break;
+
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+
+            col = options[x % (uint64_t)nOptions];
+            moves[pos.nMoves] = (char)('1' +col);
+            positionPlay(&pos, col, who);
+            who = nextPlayerIndex(who);
+        }
+
+        // Dead ends are thrown away
+        if (pos.nMoves < discs) continue;
+
+        moves[pos.nMoves] = '\0';
+
+        int score = solveColumns(&pos, who, best);
+        printf("%s %d %s\n", moves, score, best);
+        fflush(stdout);
+
+        ++n;
+    }
+
+    return 0;
+}
+
+// Exact score of pos, and every column that achieves it into best.
+static int solveColumns(Position *pos, int who, char *best) {
+
+    Solver solver;
+    int col, n = 0;
+    int scores[kBOARDS_COLS];
+    int max = -kSCORE_INFINITY;
+
+    ttClear(&solverTable);
+    solverInit(&solver, &solverTable);
+    solver.endgame = endgame;
+
+    for (col=0; col<kBOARDS_COLS; ++col) {
+
+        if (!positionCanPlay(pos, col)) continue;
+
+        if (positionIsWinningMove(pos, col, who)) {
+            scores[col] = scoreForWinAt(pos->nMoves);
+        } else {
+            positionPlay(pos, col, who);
+            scores[col] = -solverNegamax(&solver, pos, nextPlayerIndex(who), kBOARDS_CELLS, -kSCORE_INFINITY, kSCORE_INFINITY);
+            positionUndo(pos, col, who);
+        }
+
+        if (scores[col] > max) max = scores[col];
+    }
+
+    for (col=0; col<kBOARDS_COLS; ++col) {
+        if (positionCanPlay(pos, col) && scores[col] == max) best[n++] = (char)('1' +col);
+    }
+    best[n] = '\0';
+
+    return max;
+}
+
+static TestPosition* loadSet(const char *path, uint32_t *count) {
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return NULL;
+
+    uint32_t cap = 256;
+    TestPosition *set = (TestPosition *) malloc(cap*sizeof(TestPosition));
+    char line[256];
+
+    *count = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+
+        TestPosition *t = &set[*count];
+        Position pos;
+
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        if (sscanf(line, "%63s %d %15s", t->moves, &t->score, t->best) != 3 || !positionFromMoves(&pos, t->moves)) {
+            fprintf(stderr, "%s: bad line: %s", path, line);
+            continue;
+        }
+
+        if (++(*count) == cap) {
+            cap *= 2;
+            set = (TestPosition *) realloc(set, cap*sizeof(TestPosition));
+        }
+    }
+
+    fclose(f);
+
+    return set;
+}
+
+// False if a move is illegal or ends the game.
+static BOOL positionFromMoves(Position *pos, const char *moves) {
+
+    int who = 0;
+
+    memset(pos, 0, sizeof(Position));
+    if (strlen(moves) >= kBOARDS_CELLS) return false;
+
+    for (; *moves != '\0'; ++moves) {
+        int col = *moves -'1';
+        if (col < 0 || col >= kBOARDS_COLS || !positionCanPlay(pos, col) || positionIsWinningMove(pos, col, who)) return false;
+        positionPlay(pos, col, who);
+        who = nextPlayerIndex(who);
+    }
+
+    return (pos->nMoves < kBOARDS_CELLS);
+}
+
+// The board the game would show for the same moves, with players[0] first.
+static void boardFromPosition(Board *board, const Position *pos, const char players[]) {
+
+    int i, j;
+
+    board->emptyCells = kBOARDS_CELLS -pos->nMoves;
+    board->n_balls = pos->nMoves;
+
+    for (i=0; i<kBOARDS_ROWS; ++i) {
+        for (j=0; j<kBOARDS_COLS; ++j) {
+            int row = kBOARDS_ROWS -1 -i;
+            if (pos->discs[0] & bitForCell(j, row)) board->matrix[i][j] = players[0];
+            else if (pos->discs[1] & bitForCell(j, row)) board->matrix[i][j] = players[1];
+            else board->matrix[i][j] = kEMPTY;
+        }
+    }
+}
+
+static void runEngine(Engine engine, TestPosition *set, uint32_t count, Result *result) {
+
+    const char cpuChars[kMAX_ENGINES] = {kCPU_EASY, kCPU_HARD, kCPU_EXPERT, kCPU_EXPERT};
+    uint32_t i;
+
+    if (batchSize > 1 && (engine == EngineEasy || engine == EngineHard)) {
+        runEngineBatched(engine, set, count, result);
+        return;
+    }
+
+    result->positions = count;
+    result->correct = 0;
+    result->nodes = 0;
+
+    for (i=0; i<count; ++i) {
+
+        Position pos;
+        Board board;
+        int turn, move, score = 0;
+        uint64_t nodes;
+        XTime tStart, tEnd;
+
+        positionFromMoves(&pos, set[i].moves);
+        turn = pos.nMoves % 2;
+
+        // Any other char works for the opponent, the engines only tell it apart
+        char players[2];
+        players[turn] = cpuChars[engine];
+        players[nextPlayerIndex(turn)] = kPLAYER_1;
+
+        boardFromPosition(&board, &pos, players);
+
+        if (engine == EngineSolver) {
+            ttClear(&solverTable);
+        }
+
+        XTime_GetTime(&tStart);
+
+        if (engine == EngineSolver) {
+
+            Solver solver;
+            solverInit(&solver, &solverTable);
+            solver.endgame = endgame;
+            move = solverBestMove(&solver, &pos, turn, kBOARDS_CELLS, &score);
+            nodes = solver.nodes;
+
+        } else if (engine == EngineExpert) {
+
+            SearchReport report;
+            move = CPUsChoiceWithinTime(&board, players, turn, expertMs, false, &report);
+            nodes = CPUsLastSearchNodes();
+
+        } else {
+
+            move = CPUsChoice(&board, players, turn, (engine == EngineEasy ? kCPU_EASY_MAX_DEPTH : kCPU_HARD_MAX_DEPTH), false);
+            nodes = CPUsLastSearchNodes();
+        }
+
+        XTime_GetTime(&tEnd);
+
+        result->ms[i] = (double)(tEnd -tStart)*1000.0 /COUNTS_PER_SECOND;
+        result->nodes += nodes;
+
+        judgeMove(engine, &set[i], move, score, result);
+    }
+}
+
+static void runEngineBatched(Engine engine, TestPosition *set, uint32_t count, Result *result) {
+
+    const char cpuChar = (engine == EngineEasy ? kCPU_EASY : kCPU_HARD);
+    Board *boards = (Board *) malloc(batchSize*sizeof(Board));
+    char (*players)[2] = (char (*)[2]) malloc(batchSize*sizeof(*players));
+    CPUsRequest *requests = (CPUsRequest *) malloc(batchSize*sizeof(CPUsRequest));
+    int *answers = (int *) malloc(batchSize*sizeof(int));
+    uint32_t first, i;
+
+    result->positions = count;
+    result->correct = 0;
+    result->nodes = 0;
+
+    for (first=0; first<count; first+=batchSize) {
+
+        uint32_t n = (count -first < (uint32_t)batchSize ? count -first : (uint32_t)batchSize);
+        XTime tStart, tEnd;
+
+        for (i=0; i<n; ++i) {
+
+            Position pos;
+            positionFromMoves(&pos, set[first +i].moves);
+
+            int turn = pos.nMoves % 2;
+            players[i][turn] = cpuChar;
+            players[i][nextPlayerIndex(turn)] = kPLAYER_1;
+            boardFromPosition(&boards[i], &pos, players[i]);
+
+            requests[i].board = &boards[i];
+            requests[i].players = players[i];
+            requests[i].turn = turn;
+            requests[i].maxAiSteps = (engine == EngineEasy ? kCPU_EASY_MAX_DEPTH : kCPU_HARD_MAX_DEPTH);
+        }
+
+        XTime_GetTime(&tStart);
+        CPUsChoices(requests, (int)n, answers);
+        XTime_GetTime(&tEnd);
+
+        result->nodes += CPUsLastSearchNodes();
+
+        for (i=0; i<n; ++i) {
+            result->ms[first +i] = (double)(tEnd -tStart)*1000.0 /COUNTS_PER_SECOND /n;
+            judgeMove(engine, &set[first +i], answers[i], 0, result);
+        }
+    }
+
+    free(boards);
+    free(players);
+    free(requests);
+    free(answers);
+}
+
+// Only the solver claims a score, the others are judged by their move
+static void judgeMove(Engine engine, const TestPosition *test, int move, int score, Result *result) {
+
+    BOOL correct = (move >= 0 && strchr(test->best, '1' +move) != NULL);
+    if (engine == EngineSolver && score != test->score) correct = false;
+
+    if (correct) ++(result->correct);
+    else fprintf(stderr, "%s: %s expected %d %s, got column %d\n", engineNames[engine], test->moves, test->score, test->best, move +1);
+}
+
+static void printResult(Engine engine, const char *setName, Result *result) {
+
+    uint32_t i, n = result->positions;
+    double total = 0, p99 = 0, max = 0;
+
+    for (i=0; i<n; ++i) total += result->ms[i];
+
+    if (n > 0) {
+        qsort(result->ms, n, sizeof(double), compareTimes);
+        p99 = result->ms[(n*99 +99)/100 -1];
+        max = result->ms[n -1];
+    }
+
+    printf("%s,%s,%u,%u,%llu,%.0f,%.3f,%.3f,%.3f\n",
+           engineNames[engine], setName, n, result->correct,
+           (unsigned long long)result->nodes,
+           (total > 0 ? result->nodes*1000.0 /total : 0),
+           (n > 0 ? total /n : 0), p99, max);
+}
+
+static int compareTimes(const void *a, const void *b) {
+    double ta = *(const double *)a;
+    double tb = *(const double *)b;
+    return (ta > tb) - (ta < tb);
+}
@@ -0,0 +1,345 @@
+// Offline endgame table generator. Plays -g seeded random lines until only
+// -e cells are left empty, then solves every position below each of them
+// exhaustively and writes them in the format described in EndgameTable.h.
+// With USE_PTHREADS, the lines are shared among -t threads.
+//
+//   EndgameGenerator [-e max_empty] [-g games] [-s seed] [-t threads] -o endgame.bin
+
+#include "Solver.h"
+#include "EndgameTable.h"
+#include <string.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define nextPlayerIndex(_curr) ((_curr+1)%2)
+
+// Every position solved by one worker, by key. 0 is never a valid key.
+typedef struct {
+    uint64_t *keys;
+    int8_t *scores;
+    uint32_t mask, count;
+    uint32_t lines;
+} Worker;
+
+typedef struct {
+    uint64_t key;
+    int8_t score;
+} EndgameEntry;
+
+static int maxEmpty, nGames;
+static uint64_t baseSeed;
+
+#ifdef USE_PTHREADS
+static pthread_mutex_t nextGameLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static int nextGame;
+
+static void* workerMain(void *arg);
+static BOOL randomLine(Position *pos, int *who, uint64_t seed);
+static int solveExact(Worker *worker, Position *pos, int who);
+static int8_t* memoFind(Worker *worker, uint64_t key, BOOL insert);
+static int compareEntries(const void *a, const void *b);
+static BOOL writeTable(const char *path, EndgameEntry *entries, uint32_t count);
+
+int main(int argc, char *argv[]) {
+
+    const char *path = NULL;
+    int nThreads = 1;
+    int i, k;
+
+    maxEmpty = 8;
+    nGames = 1000;
+    baseSeed = 1;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-e") == 0 && i+1 < argc) maxEmpty = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-g") == 0 && i+1 < argc) nGames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) baseSeed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-t") == 0 && i+1 < argc) nThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) path = argv[++i];
+        else {
+            path = NULL;
+            break;
+        }
+    }
+
+    if (path == NULL || maxEmpty < 1 || maxEmpty > kBOARDS_CELLS || nGames < 1 || nThreads < 1) {
+        fprintf(stderr, "usage: %s [-e max_empty] [-g games] [-s seed] [-t threads] -o endgame.bin\n", argv[0]);
+        return 1;
+    }
+
+#ifndef USE_PTHREADS
+    nThreads = 1;
+#endif
+
+    initZobristKeys();
+
+    Worker *workers = (Worker *) calloc(nThreads, sizeof(Worker));
+    if (workers == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+#ifdef USE_PTHREADS
+    pthread_t *threads = (pthread_t *) calloc(nThreads, sizeof(pthread_t));
+    if (threads == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (k=1; k<nThreads; ++k) {
+        if (pthread_create(&threads[k], NULL, workerMain, &workers[k]) != 0) {
+            fprintf(stderr, "can't start worker thread %d\n", k);
+            return 1;
+        }
+    }
+    workerMain(&workers[0]);
+    for (k=1; k<nThreads; ++k) pthread_join(threads[k], NULL);
+    free(threads);
+#else
+    workerMain(&workers[0]);
+#endif
+
+    // Merges the workers' positions. The same position always gets the same
+    // score, so duplicates are simply dropped.
+    uint32_t total = 0, n = 0, lines = 0;
+    for (k=0; k<nThreads; ++k) {
+        total += workers[k].count;
+        lines += workers[k].lines;
+    }
+
+    EndgameEntry *entries = (EndgameEntry *) malloc((size_t)(total > 0 ? total : 1)*sizeof(EndgameEntry));
+    if (entries == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (k=0; k<nThreads; ++k) {
+        uint32_t j;
+        for (j=0; workers[k].keys != NULL && j<=workers[k].mask; ++j) {
+            if (workers[k].keys[j] == 0) continue;
+            entries[n].key = workers[k].keys[j];
+            entries[n].score = workers[k].scores[j];
+            ++n;
+        }
+        free(workers[k].keys);
+        free(workers[k].scores);
+    }
+
+    qsort(entries, n, sizeof(EndgameEntry), compareEntries);
+
+    uint32_t unique = 0;
+    for (i=0; (uint32_t)i<n; ++i) {
+        if (unique == 0 || entries[unique -1].key != entries[i].key) entries[unique++] = entries[i];
+    }
+
+    if (!writeTable(path, entries, unique)) {
+        fprintf(stderr, "can't write %s\n", path);
+        return 1;
+    }
+
+    fprintf(stderr, "%u lines, %u positions\n", lines, unique);
+
+    free(entries);
+    free(workers);
+
+    return 0;
+}
+
+static void* workerMain(void *arg) {
+
+    Worker *worker = (Worker *) arg;
+
+    while (1) {
+
+#ifdef USE_PTHREADS
+        pthread_mutex_lock(&nextGameLock);
+#endif
+        int g = nextGame++;
+#ifdef USE_PTHREADS
+        pthread_mutex_unlock(&nextGameLock);
+#endif
+
+        if (g >= nGames) break;
+
+        Position pos;
+        int who;
+
+        // Lines that end early with a win have no endgame
+        if (!randomLine(&pos, &who, baseSeed*0x9E3779B97F4A7C15ULL +(uint64_t)g)) continue;
+
+        solveExact(worker, &pos, who);
+        ++(worker->lines);
+    }
+
+    return NULL;
+}
+
+// Random moves that don't win on the spot, until maxEmpty cells are left.
+// Returns false if a player is left with nothing but winning moves.
+static BOOL randomLine(Position *pos, int *who, uint64_t seed) {
+
+    uint64_t x = seed | 1;
+    int col, options[kBOARDS_COLS];
+
+    memset(pos, 0, sizeof(Position));
+    *who = 0;
+
+    while (kBOARDS_CELLS -pos->nMoves > maxEmpty) {
+
+        int n = 0;
+        for (col=0; col<kBOARDS_COLS; ++col) {
+            if (positionCanPlay(pos, col) && !positionIsWinningMove(pos, col, *who)) options[n++] = col;
+        }
+        if (n == 0) return false;
+
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        positionPlay(pos, options[x % n], *who);
+        *who = nextPlayerIndex(*who);
+    }
+
+    return true;
+}
+
+// Plain minimax without pruning, so that every position below gets its
+// exact score, not just a bound.
+static int solveExact(Worker *worker, Position *pos, int who) {
+
+    uint64_t key = endgameKeyForPosition(pos, who);
+    int8_t *memo = memoFind(worker, key, false);
+
+    if (memo != NULL) return *memo;
+
+    int col, best = 0;
+
+    if (pos->nMoves < kBOARDS_CELLS) {
+
+        BOOL canWin = false;
+
+        for (col=0; col<kBOARDS_COLS; ++col) {
+            if (positionCanPlay(pos, col) && positionIsWinningMove(pos, col, who)) {
+                canWin = true;
+                break;
+            }
+        }
+
+        if (canWin) {
+            best = scoreForWinAt(pos->nMoves);
+        } else {
+            best = -kSCORE_INFINITY;
+            for (col=0; col<kBOARDS_COLS; ++col) {
+                if (!positionCanPlay(pos, col)) continue;
+                positionPlay(pos, col, who);
+                int value = -solveExact(worker, pos, nextPlayerIndex(who));
+                positionUndo(pos, col, who);
+                if (value > best) best = value;
+            }
+        }
+    }
+
+    *memoFind(worker, key, true) = (int8_t)best;
+
+    return best;
+}
+
+// Returns the score slot of key, or NULL if absent and !insert.
+static int8_t* memoFind(Worker *worker, uint64_t key, BOOL insert) {
+
+    if (insert && (worker->count +1)*2 > worker->mask) {
+
+        uint32_t oldMask = worker->mask, i;
+        uint64_t *oldKeys = worker->keys;
+        int8_t *oldScores = worker->scores;
+
+        worker->mask = (oldMask == 0 ? (1u << 16) -1 : oldMask*2 +1);
+        worker->keys = (uint64_t *) calloc((size_t)worker->mask +1, sizeof(uint64_t));
+        worker->scores = (int8_t *) calloc((size_t)worker->mask +1, sizeof(int8_t));
+        if (worker->keys == NULL || worker->scores == NULL) {
+            fprintf(stderr, "out of memory for %u positions\n", worker->count);
+            exit(1);
+        }
+
+        for (i=0; oldKeys != NULL && i<=oldMask; ++i) {
+            if (oldKeys[i] == 0) continue;
+            uint32_t j = (uint32_t)(oldKeys[i] >> 32) & worker->mask;
+            while (worker->keys[j] != 0) j = (j+1) & worker->mask;
+            worker->keys[j] = oldKeys[i];
+            worker->scores[j] = oldScores[i];
+        }
+
+        free(oldKeys);
+        free(oldScores);
+    }
+
+    if (worker->keys == NULL) return NULL;
+
+    uint32_t j = (uint32_t)(key >> 32) & worker->mask;
+
+    while (worker->keys[j] != 0) {
+        if (worker->keys[j] == key) return &worker->scores[j];
+        j = (j+1) & worker->mask;
+    }
+
+    if (!insert) return NULL;
+
+    worker->keys[j] = key;
+    ++(worker->count);
+
+    return &worker->scores[j];
+}
+
+static int compareEntries(const void *a, const void *b) {
+    uint64_t ka = ((const EndgameEntry *)a)->key;
+    uint64_t kb = ((const EndgameEntry *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static BOOL writeTable(const char *path, EndgameEntry *entries, uint32_t count) {
+
+    // About 16 keys per bucket
+    int bits = 0;
+    while (bits < 24 && ((uint64_t)16 << (bits +1)) <= count) ++bits;
+
+    size_t bucketsSize = endgameBucketsSize(bits);
+    uint32_t *buckets = (uint32_t *) calloc(bucketsSize, 1);
+    uint32_t b, i = 0;
+
+    if (buckets == NULL) return false;
+
+    for (b=0; b<(1u << bits); ++b) {
+        while (i < count && bits > 0 && (entries[i].key >> (64 -bits)) < b) ++i;
+        buckets[b] = i;
+    }
+    buckets[1u << bits] = count;
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        free(buckets);
+        return false;
+    }
+
+    EndgameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kENDGAME_MAGIC;
+    header.version = kENDGAME_VERSION;
+    header.cols = kBOARDS_COLS;
+    header.rows = kBOARDS_ROWS;
+    header.lenToWin = kLEN_TO_WIN;
+    header.maxEmpty = (uint8_t)maxEmpty;
+    header.indexBits = (uint8_t)bits;
+    header.count = count;
+
+    BOOL ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+    ok = ok && (fwrite(buckets, bucketsSize, 1, f) == 1);
+
+    for (i=0; i<count && ok; ++i) ok = (fwrite(&entries[i].key, sizeof(uint64_t), 1, f) == 1);
+    for (i=0; i<count && ok; ++i) ok = (fwrite(&entries[i].score, 1, 1, f) == 1);
+
+    free(buckets);
+
+    return (fclose(f) == 0 && ok);
+}
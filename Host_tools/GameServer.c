@@ -0,0 +1,795 @@
+// Hosts many games at once, each between a client and a CPU player, for
+// clients on a Unix socket or, with -i, for one client on stdin and stdout.
+// The moves the CPUs owe are queued, and a thread of their own answers them
+// in batches with CPUsChoices(), which searches with -j threads.
+//
+//   GameServer [-u socket] [-i] [-j threads] [-q queue] [-n sessions] [-m table_MB] [-b book.bin] [-x endgame.bin]
+//
+// One command per line, columns from 1 as in the other tools:
+//
+//   new easy|hard|expert [cpu]   ok <id>                 cpu: the CPU moves first
+//   play <id> <col>              move <id> <col>         the CPU's answer, when searched
+//                                end <id> win|loss|tie   once the game is over
+//   stats <id>                   stats <id> moves <n> mean_us <t> p99_us <t> max_us <t> queue_us <t>
+//   close <id>                   closed <id>
+//   server                       server sessions <n> queued <n> moves <n> batches <n> moves_per_sec <n>
+//
+// and "error <id> <reason>" for the commands that can't be carried out (id
+// is - if there is none). A session belongs to the connection that opened
+// it and is closed with it.
+//
+// Backpressure: at most -q CPU moves are queued or being searched. While the
+// queue is full the server reads no more commands, and the writes of its
+// clients block. A session has one CPU move queued at most: playing again
+// before its answer is an error. Session latencies go from reading the
+// command to writing the answer, queue times from reading it to the start
+// of its search.
+
+#include "AI.h"
+#include "Bitboard.h"
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define kMAX_CONNECTIONS    256
+#define kMAX_BATCH          256     // CPU moves per CPUsChoices() call
+#define kLINE_LENGTH        128
+#define kIN_BUFFER          4096
+
+#define kCLIENT             kPLAYER_1
+#define nextPlayerIndex(_curr) ((_curr+1)%2)
+#define microsBetween(_t0,_t1) ((uint64_t)((_t1) -(_t0))*1000000 /COUNTS_PER_SECOND)
+
+typedef struct {
+    uint32_t moves;
+    uint64_t totalMicros, maxMicros, queueMicros;
+    uint32_t latency[kLATENCY_BUCKETS];     // As in SearchStats
+} SessionMetrics;
+
+typedef struct {
+    BOOL inUse;
+    uint32_t generation;        // Tells the answers for a closed session from those for the next in its slot
+    int connection;
+    Position pos;
+    Board board;                // The same discs, for CPUsChoices()
+    char players[2];            // players[0] moves first
+    int cpu;                    // Index of the CPU in players
+    int depth;
+    BOOL waiting;               // A CPU move is queued
+    BOOL over;
+    int nextFree;
+    SessionMetrics metrics;
+} Session;
+
+typedef struct {
+    int session;
+    uint32_t generation;
+    Board board;
+    char players[2];
+    int turn, depth;
+    XTime tQueued, tStarted;
+    int answer;
+} Job;
+
+// Ring of jobs, guarded by queueLock
+typedef struct {
+    Job *jobs;
+    int first, count;
+} JobRing;
+
+typedef struct {
+    BOOL inUse;
+    int inFd, outFd;
+    BOOL eof;
+    char in[kIN_BUFFER];
+    int inLength;
+    char *out;
+    size_t outLength, outCapacity;
+} Connection;
+
+static Session *sessions;
+static int maxSessions, firstFree, openSessions;
+
+static Connection connections[kMAX_CONNECTIONS];
+static int listener = -1;
+static BOOL stdinMode = false;
+
+// Main thread to engine thread and back. inFlight is only touched by the main thread.
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueReady = PTHREAD_COND_INITIALIZER;
+static JobRing queued, answered;
+static int maxQueued, inFlight;
+static int wakePipe[2];
+
+static uint64_t movesAnswered, batches;
+static XTime tStartup;
+
+static void* engineMain(void *arg);
+static void ringPush(JobRing *ring, const Job *job);
+static BOOL ringPop(JobRing *ring, Job *job);
+static BOOL openListener(const char *path);
+static int addConnection(int inFd, int outFd);
+static void closeConnection(int c);
+static void acceptClients();
+static void readClient(int c);
+static void processLines(int c);
+static void runCommand(int c, char *line);
+static void flushClient(int c);
+static void reply(int c, const char *format, ...);
+static int openSession(int c, char cpuChar, BOOL cpuFirst);
+static void closeSession(int id);
+static Session* sessionForCommand(int c, const char *idText, int *id);
+static void playClientMove(int c, int id, Session *session, int col);
+static void queueCPUMove(int id, Session *session);
+static void drainAnswers();
+static void playDisc(Session *session, int col, int who);
+static void replyStats(int c, int id, const Session *session);
+static void replyServer(int c);
+
+int main(int argc, char *argv[]) {
+
+    const char *path = "/tmp/connect4.sock", *bookPath = NULL, *endgamePath = NULL;
+    int threads = 1, i;
+    size_t tableMB = 16;
+
+    maxQueued = 1024;
+    maxSessions = 10000;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-u") == 0 && i+1 < argc) path = argv[++i];
+        else if (strcmp(argv[i], "-i") == 0) stdinMode = true;
+        else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0 && i+1 < argc) maxQueued = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i+1 < argc) maxSessions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i+1 < argc) tableMB = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) bookPath = argv[++i];
+        else if (strcmp(argv[i], "-x") == 0 && i+1 < argc) endgamePath = argv[++i];
+        else break;
+    }
+
+    if (i < argc || threads < 1 || maxQueued < 1 || maxSessions < 1) {
+        fprintf(stderr, "usage: %s [-u socket] [-i] [-j threads] [-q queue] [-n sessions] [-m table_MB] [-b book.bin] [-x endgame.bin]\n", argv[0]);
+        return 1;
+    }
+
+    initZobristKeys();
+
+#ifdef USE_MMAP
+    static OpeningBook book;
+    static EndgameTable endgame;
+
+    if (bookPath != NULL) {
+        if (!bookOpen(&book, bookPath)) {
+            fprintf(stderr, "can't open %s\n", bookPath);
+            return 1;
+        }
+        setCPUsOpeningBook(&book);
+    }
+
+    if (endgamePath != NULL) {
+        if (!endgameOpen(&endgame, endgamePath)) {
+            fprintf(stderr, "can't open %s\n", endgamePath);
+            return 1;
+        }
+        setCPUsEndgameTable(&endgame);
+    }
+#else
+    if (bookPath != NULL || endgamePath != NULL) {
+        fprintf(stderr, "books and endgame tables need a build with USE_MMAP\n");
+        return 1;
+    }
+#endif
+
+    setCPUsThreads(threads);
+    setCPUsMemoryBudget(tableMB*1024*1024);
+    CPUsReserve();
+
+    sessions = (Session *) calloc(maxSessions, sizeof(Session));
+    queued.jobs = (Job *) malloc(maxQueued*sizeof(Job));
+    answered.jobs = (Job *) malloc(maxQueued*sizeof(Job));
+
+    if (sessions == NULL || queued.jobs == NULL || answered.jobs == NULL) {
+        fprintf(stderr, "can't allocate %d sessions and %d queued moves\n", maxSessions, maxQueued);
+        return 1;
+    }
+
+    // Free slots in order, so ids start from 0
+    for (i=0; i<maxSessions; ++i) sessions[i].nextFree = (i+1 < maxSessions ? i+1 : -1);
+    firstFree = 0;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (pipe(wakePipe) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    if (stdinMode) {
+        fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK);
+        fcntl(STDOUT_FILENO, F_SETFL, O_NONBLOCK);
+        addConnection(STDIN_FILENO, STDOUT_FILENO);
+    } else if (!openListener(path)) {
+        return 1;
+    } else {
+        fprintf(stderr, "listening on %s\n", path);
+    }
+
+    XTime_GetTime(&tStartup);
+
+    pthread_t engine;
+    if (pthread_create(&engine, NULL, engineMain, NULL) != 0) {
+        fprintf(stderr, "can't start the engine thread\n");
+        return 1;
+    }
+
+    while (true) {
+
+        struct pollfd fds[kMAX_CONNECTIONS +2];
+        int owners[kMAX_CONNECTIONS +2];
+        int n = 0, c;
+
+        drainAnswers();
+
+        for (c=0; c<kMAX_CONNECTIONS; ++c) {
+            if (connections[c].inUse) processLines(c);
+        }
+
+        for (c=0; c<kMAX_CONNECTIONS; ++c) {
+            if (connections[c].inUse) flushClient(c);
+        }
+
+        // On stdin, the server is done once the last answer is out
+        if (stdinMode && !connections[0].inUse) break;
+        if (stdinMode && connections[0].eof && inFlight == 0 && connections[0].outLength == 0 &&
+            memchr(connections[0].in, '\n', connections[0].inLength) == NULL) break;
+
+        fds[n].fd = wakePipe[0];
+        fds[n].events = POLLIN;
+        owners[n++] = -1;
+
+        if (listener >= 0) {
+            fds[n].fd = listener;
+            fds[n].events = POLLIN;
+            owners[n++] = -2;
+        }
+
+        for (c=0; c<kMAX_CONNECTIONS; ++c) {
+
+            Connection *conn = &connections[c];
+            if (!conn->inUse) continue;
+
+            // No more reading while the queue is full, or before the lines already read are used
+            BOOL reading = (!conn->eof && inFlight < maxQueued && memchr(conn->in, '\n', conn->inLength) == NULL);
+
+            if (conn->inFd == conn->outFd) {
+                fds[n].fd = conn->inFd;
+                fds[n].events = (reading ? POLLIN : 0) | (conn->outLength > 0 ? POLLOUT : 0);
+                owners[n++] = c;
+            } else {
+                fds[n].fd = (reading ? conn->inFd : -1);
+                fds[n].events = POLLIN;
+                owners[n++] = c;
+                fds[n].fd = (conn->outLength > 0 ? conn->outFd : -1);
+                fds[n].events = POLLOUT;
+                owners[n++] = c;
+            }
+        }
+
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+
+        for (i=0; i<n; ++i) {
+
+            if (fds[i].fd < 0 || fds[i].revents == 0) continue;
+
+            if (owners[i] == -1) {
+                char drain[64];
+                while (read(wakePipe[0], drain, sizeof(drain)) > 0);
+            } else if (owners[i] == -2) {
+                acceptClients();
+            } else if (connections[owners[i]].inUse) {
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) readClient(owners[i]);
+                if (connections[owners[i]].inUse && (fds[i].revents & POLLOUT)) flushClient(owners[i]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Takes every queued move, up to kMAX_BATCH, and answers them with one call.
+static void* engineMain(void *arg) {
+
+    static Job jobs[kMAX_BATCH];
+    static CPUsRequest requests[kMAX_BATCH];
+    static int answers[kMAX_BATCH];
+    int n, i;
+
+    (void)arg;
+
+    while (true) {
+
+        pthread_mutex_lock(&queueLock);
+        while (queued.count == 0) pthread_cond_wait(&queueReady, &queueLock);
+        for (n=0; n<kMAX_BATCH && ringPop(&queued, &jobs[n]); ++n);
+        pthread_mutex_unlock(&queueLock);
+
+        XTime tStarted;
+        XTime_GetTime(&tStarted);
+
+        for (i=0; i<n; ++i) {
+            jobs[i].tStarted = tStarted;
+            requests[i].board = &jobs[i].board;
+            requests[i].players = jobs[i].players;
+            requests[i].turn = jobs[i].turn;
+            requests[i].maxAiSteps = jobs[i].depth;
+        }
+
+        CPUsChoices(requests, n, answers);
+
+        pthread_mutex_lock(&queueLock);
+        for (i=0; i<n; ++i) {
+            jobs[i].answer = answers[i];
+            ringPush(&answered, &jobs[i]);
+        }
+        ++batches;
+        pthread_mutex_unlock(&queueLock);
+
+        // Wakes up the main thread
+        char byte = 0;
+        if (write(wakePipe[1], &byte, 1) < 0 && errno != EAGAIN) perror("write");
+    }
+
+    return NULL;
+}
+
+// Both rings have room for every move in flight, so neither can overflow.
+static void ringPush(JobRing *ring, const Job *job) {
+    ring->jobs[(ring->first +ring->count) %maxQueued] = *job;
+    ++(ring->count);
+}
+
+static BOOL ringPop(JobRing *ring, Job *job) {
+    if (ring->count == 0) return false;
+    *job = ring->jobs[ring->first];
+    ring->first = (ring->first +1) %maxQueued;
+    --(ring->count);
+    return true;
+}
+
+static BOOL openListener(const char *path) {
+
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        perror(path);
+        return false;
+    }
+
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+
+    return true;
+}
+
+static int addConnection(int inFd, int outFd) {
+
+    int c;
+
+    for (c=0; c<kMAX_CONNECTIONS && connections[c].inUse; ++c);
+    if (c == kMAX_CONNECTIONS) return -1;
+
+    memset(&connections[c], 0, sizeof(Connection));
+    connections[c].inUse = true;
+    connections[c].inFd = inFd;
+    connections[c].outFd = outFd;
+
+    return c;
+}
+
+// Its sessions go with it. Their queued moves are searched, but not answered.
+static void closeConnection(int c) {
+
+    int id;
+
+    for (id=0; id<maxSessions; ++id) {
+        if (sessions[id].inUse && sessions[id].connection == c) closeSession(id);
+    }
+
+    if (connections[c].inFd != STDIN_FILENO) close(connections[c].inFd);
+    free(connections[c].out);
+    connections[c].inUse = false;
+}
+
+static void acceptClients() {
+
+    int fd;
+
+    while ((fd = accept(listener, NULL, NULL)) >= 0) {
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+
+        if (addConnection(fd, fd) < 0) {
+            const char *full = "error - connections\n";
+            if (write(fd, full, strlen(full)) < 0) perror("write");
+            close(fd);
+        }
+    }
+}
+
+static void readClient(int c) {
+
+    Connection *conn = &connections[c];
+    ssize_t n = read(conn->inFd, conn->in +conn->inLength, kIN_BUFFER -conn->inLength);
+
+    if (n > 0) {
+        conn->inLength += (int)n;
+        // A line that fills the buffer is cut short rather than wait forever
+        if (conn->inLength == kIN_BUFFER && memchr(conn->in, '\n', conn->inLength) == NULL) {
+            conn->in[kIN_BUFFER -1] = '\n';
+        }
+        processLines(c);
+        return;
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+
+    // On a socket nobody is left to answer; on stdin the answers still go out
+    conn->eof = true;
+    if (conn->inLength > 0 && conn->inLength < kIN_BUFFER && conn->in[conn->inLength -1] != '\n') {
+        conn->in[conn->inLength++] = '\n';
+    }
+    if (!stdinMode) closeConnection(c);
+}
+
+// Runs the complete lines read so far, while there is room in the queue.
+static void processLines(int c) {
+
+    Connection *conn = &connections[c];
+    char *start = conn->in;
+    char *end;
+    int used;
+
+    while (conn->inUse && inFlight < maxQueued && (end = memchr(start, '\n', conn->in +conn->inLength -start)) != NULL) {
+        *end = '\0';
+        if (end > start && end[-1] == '\r') end[-1] = '\0';
+        runCommand(c, start);
+        start = end +1;
+    }
+
+    if (!conn->inUse) return;
+
+    used = (int)(start -conn->in);
+    memmove(conn->in, start, conn->inLength -used);
+    conn->inLength -= used;
+}
+
+static void runCommand(int c, char *line) {
+
+    char *save;
+    char *command = strtok_r(line, " \t", &save);
+    char *arg1 = strtok_r(NULL, " \t", &save);
+    char *arg2 = strtok_r(NULL, " \t", &save);
+    int id;
+    Session *session;
+
+    if (command == NULL) return;
+
+    if (strcmp(command, "new") == 0) {
+
+        char cpuChar = (arg1 == NULL ? 0 : (strcmp(arg1, "easy") == 0 ? kCPU_EASY :
+                       (strcmp(arg1, "hard") == 0 ? kCPU_HARD : (strcmp(arg1, "expert") == 0 ? kCPU_EXPERT : 0))));
+
+        if (cpuChar == 0) {
+            reply(c, "error - cpu\n");
+            return;
+        }
+
+        id = openSession(c, cpuChar, (arg2 != NULL && strcmp(arg2, "cpu") == 0));
+        if (id < 0) reply(c, "error - sessions\n");
+
+    } else if (strcmp(command, "play") == 0) {
+
+        if ((session = sessionForCommand(c, arg1, &id)) == NULL) return;
+        playClientMove(c, id, session, (arg2 != NULL ? atoi(arg2) -1 : -1));
+
+    } else if (strcmp(command, "stats") == 0) {
+
+        if ((session = sessionForCommand(c, arg1, &id)) == NULL) return;
+        replyStats(c, id, session);
+
+    } else if (strcmp(command, "close") == 0) {
+
+        if ((session = sessionForCommand(c, arg1, &id)) == NULL) return;
+        closeSession(id);
+        reply(c, "closed %d\n", id);
+
+    } else if (strcmp(command, "server") == 0) {
+
+        replyServer(c);
+
+    } else {
+        reply(c, "error - command\n");
+    }
+}
+
+static void flushClient(int c) {
+
+    Connection *conn = &connections[c];
+
+    while (conn->outLength > 0) {
+
+        ssize_t n = write(conn->outFd, conn->out, conn->outLength);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) return;
+            // The client is gone
+            if (stdinMode) conn->outLength = 0;
+            else closeConnection(c);
+            return;
+        }
+
+        memmove(conn->out, conn->out +n, conn->outLength -n);
+        conn->outLength -= n;
+    }
+}
+
+// Appends a line to the output of the connection, written out by flushClient().
+static void reply(int c, const char *format, ...) {
+
+    Connection *conn = &connections[c];
+    char line[kLINE_LENGTH];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (n < 0) return;
+    if (n >= (int)sizeof(line)) n = sizeof(line) -1;
+
+    if (conn->outLength +n > conn->outCapacity) {
+        size_t capacity = (conn->outCapacity == 0 ? kIN_BUFFER : conn->outCapacity*2);
+        while (capacity < conn->outLength +n) capacity *= 2;
+        char *out = (char *) realloc(conn->out, capacity);
+        if (out == NULL) return;
+        conn->out = out;
+        conn->outCapacity = capacity;
+    }
+
+    memcpy(conn->out +conn->outLength, line, n);
+    conn->outLength += n;
+}
+
+static int openSession(int c, char cpuChar, BOOL cpuFirst) {
+
+    int id = firstFree;
+    if (id < 0) return -1;
+
+    Session *session = &sessions[id];
+    firstFree = session->nextFree;
+    ++openSessions;
+
+    uint32_t generation = session->generation +1;
+    memset(session, 0, sizeof(Session));
+    session->generation = generation;
+    session->inUse = true;
+    session->connection = c;
+
+    session->cpu = (cpuFirst ? 0 : 1);
+    session->players[session->cpu] = cpuChar;
+    session->players[nextPlayerIndex(session->cpu)] = kCLIENT;
+    session->depth = (cpuChar == kCPU_EASY ? kCPU_EASY_MAX_DEPTH : (cpuChar == kCPU_HARD ? kCPU_HARD_MAX_DEPTH : kCPU_EXPERT_MAX_DEPTH));
+
+    memset(session->board.matrix, kEMPTY, sizeof(session->board.matrix));
+    session->board.emptyCells = kBOARDS_CELLS;
+    session->board.n_balls = 0;
+    memset(&session->pos, 0, sizeof(Position));
+
+    reply(c, "ok %d\n", id);
+
+    if (cpuFirst) queueCPUMove(id, session);
+
+    return id;
+}
+
+static void closeSession(int id) {
+
+    Session *session = &sessions[id];
+
+    session->inUse = false;
+    session->nextFree = firstFree;
+    firstFree = id;
+    --openSessions;
+}
+
+// The session named by idText, if it belongs to connection c. Replies with an error otherwise.
+static Session* sessionForCommand(int c, const char *idText, int *id) {
+
+    char *end;
+    long n = (idText != NULL ? strtol(idText, &end, 10) : -1);
+
+    if (idText == NULL || *end != '\0' || n < 0 || n >= maxSessions || !sessions[n].inUse || sessions[n].connection != c) {
+        reply(c, "error - session\n");
+        return NULL;
+    }
+
+    *id = (int)n;
+    return &sessions[n];
+}
+
+static void playClientMove(int c, int id, Session *session, int col) {
+
+    int client = nextPlayerIndex(session->cpu);
+
+    if (session->over) {
+        reply(c, "error %d over\n", id);
+        return;
+    }
+
+    if (session->waiting) {
+        reply(c, "error %d busy\n", id);
+        return;
+    }
+
+    if (col < 0 || col >= kBOARDS_COLS || !positionCanPlay(&session->pos, col)) {
+        reply(c, "error %d column\n", id);
+        return;
+    }
+
+    BOOL wins = positionIsWinningMove(&session->pos, col, client);
+    playDisc(session, col, client);
+
+    if (wins) {
+        session->over = true;
+        reply(c, "end %d win\n", id);
+    } else if (session->pos.nMoves == kBOARDS_CELLS) {
+        session->over = true;
+        reply(c, "end %d tie\n", id);
+    } else {
+        queueCPUMove(id, session);
+    }
+}
+
+static void queueCPUMove(int id, Session *session) {
+
+    Job job;
+
+    job.session = id;
+    job.generation = session->generation;
+    job.board = session->board;
+    job.players[0] = session->players[0];
+    job.players[1] = session->players[1];
+    job.turn = session->cpu;
+    job.depth = session->depth;
+    XTime_GetTime(&job.tQueued);
+
+    session->waiting = true;
+    ++inFlight;
+
+    pthread_mutex_lock(&queueLock);
+    ringPush(&queued, &job);
+    pthread_cond_signal(&queueReady);
+    pthread_mutex_unlock(&queueLock);
+}
+
+// Plays the answers of the CPUs and sends them to their clients.
+static void drainAnswers() {
+
+    Job job;
+    XTime now;
+
+    XTime_GetTime(&now);
+
+    while (true) {
+
+        pthread_mutex_lock(&queueLock);
+        BOOL any = ringPop(&answered, &job);
+        pthread_mutex_unlock(&queueLock);
+
+        if (!any) break;
+
+        --inFlight;
+        ++movesAnswered;
+
+        Session *session = &sessions[job.session];
+        if (!session->inUse || session->generation != job.generation) continue;
+
+        int c = session->connection;
+        int col = job.answer;
+        BOOL wins = positionIsWinningMove(&session->pos, col, session->cpu);
+
+        playDisc(session, col, session->cpu);
+        session->waiting = false;
+
+        SessionMetrics *metrics = &session->metrics;
+        uint64_t micros = microsBetween(job.tQueued, now);
+        int bucket = 0;
+
+        ++(metrics->moves);
+        metrics->totalMicros += micros;
+        metrics->queueMicros += microsBetween(job.tQueued, job.tStarted);
+        if (micros > metrics->maxMicros) metrics->maxMicros = micros;
+        while (bucket < kLATENCY_BUCKETS -1 && (micros >> (bucket +1)) != 0) ++bucket;
+        ++(metrics->latency[bucket]);
+
+        reply(c, "move %d %d\n", job.session, col +1);
+
+        if (wins) {
+            session->over = true;
+            reply(c, "end %d loss\n", job.session);
+        } else if (session->pos.nMoves == kBOARDS_CELLS) {
+            session->over = true;
+            reply(c, "end %d tie\n", job.session);
+        }
+    }
+}
+
+static void playDisc(Session *session, int col, int who) {
+    int row = positionPlay(&session->pos, col, who);
+    session->board.matrix[kBOARDS_ROWS -1 -row][col] = session->players[who];
+    --(session->board.emptyCells);
+    ++(session->board.n_balls);
+}
+
+// The 99th percentile is the upper end of its latency bucket.
+static void replyStats(int c, int id, const Session *session) {
+
+    const SessionMetrics *metrics = &session->metrics;
+    uint32_t seen = 0;
+    uint64_t p99 = 0;
+    int i;
+
+    for (i=0; i<kLATENCY_BUCKETS && metrics->moves > 0; ++i) {
+        seen += metrics->latency[i];
+        if ((uint64_t)seen*100 >= (uint64_t)metrics->moves*99) {
+            p99 = 2ULL << i;
+            break;
+        }
+    }
+
+    uint32_t n = (metrics->moves > 0 ? metrics->moves : 1);
+
+    reply(c, "stats %d moves %u mean_us %llu p99_us %llu max_us %llu queue_us %llu\n", id, metrics->moves,
+          (unsigned long long)(metrics->totalMicros /n), (unsigned long long)p99,
+          (unsigned long long)metrics->maxMicros, (unsigned long long)(metrics->queueMicros /n));
+}
+
+static void replyServer(int c) {
+
+    XTime now;
+    XTime_GetTime(&now);
+
+    pthread_mutex_lock(&queueLock);
+    uint64_t batchesSoFar = batches;
+    pthread_mutex_unlock(&queueLock);
+
+    uint64_t micros = microsBetween(tStartup, now);
+
+    reply(c, "server sessions %d queued %d moves %llu batches %llu moves_per_sec %llu\n", openSessions, inFlight,
+          (unsigned long long)movesAnswered, (unsigned long long)batchesSoFar,
+          (unsigned long long)(micros > 0 ? movesAnswered*1000000 /micros : 0));
+}
@@ -0,0 +1,181 @@
+// Linux stand-in for the ZYBO: buttons and switches are plain variables set
+// with halSimulateButtons()/halSimulateSwitches(), or by a script played by
+// a thread that stands in for the GPIO interrupt. The LEDs are remembered,
+// the shape list lives in memory and time comes from clock_gettime().
+// It can record every shape list the game flushes, one per frame.
+
+#include "Constants.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef struct {
+    uint32_t ms;                    // After halOnInputChange()
+    uint32_t buttons, switches;
+} ScriptStep;
+
+static volatile uint32_t buttons, switches, leds;
+static ScriptStep *script;
+static int scriptLength;
+static volatile int scriptDone;     // Steps played
+static void (*inputHandler)();
+static pthread_mutex_t inputLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t interrupted = PTHREAD_COND_INITIALIZER;
+
+// Boards larger than the VGA design's have more discs than it has slots
+#define kHOST_SHAPE_SLOTS   (kSHAPE_SLOTS +kBOARDS_CELLS)
+static uint32_t shapes[kHOST_SHAPE_SLOTS];
+static FILE *recording;
+
+void XTime_GetTime(XTime *xtime) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *xtime = (XTime)ts.tv_sec*COUNTS_PER_SECOND + (XTime)ts.tv_nsec;
+}
+
+void halInit() {
+    buttons = 0;
+    switches = 0;
+    leds = 0;
+}
+
+void halCleanup() {
+}
+
+uint32_t halReadButtons() {
+    return buttons;
+}
+
+uint32_t halReadSwitches() {
+    return switches;
+}
+
+void halWriteLEDs(uint32_t value) {
+    leds = value;
+}
+
+uint32_t* halShapeBuffer() {
+    return shapes;
+}
+
+#ifndef HEADLESS
+void halSleepMicros(uint32_t us) {
+    usleep(us);
+}
+#endif
+
+// The interrupt: the handler runs with the lock, which halMaskInput() takes
+static void* playScript(void *arg) {
+
+    XTime start, now;
+    int i;
+
+    XTime_GetTime(&start);
+
+    for (i=0; i<scriptLength; ++i) {
+
+        XTime at = start +(XTime)script[i].ms*COUNTS_PER_SECOND/1000;
+        XTime_GetTime(&now);
+        if (at > now) usleep((useconds_t)((at -now)/1000));
+
+        pthread_mutex_lock(&inputLock);
+        buttons = script[i].buttons;
+        switches = script[i].switches;
+        inputHandler();
+        scriptDone = i+1;
+        pthread_cond_broadcast(&interrupted);
+        pthread_mutex_unlock(&inputLock);
+    }
+
+    return NULL;
+}
+
+int halOnInputChange(void (*handler)()) {
+
+    pthread_t thread;
+
+    if (script == NULL) return 0;
+
+    inputHandler = handler;
+    if (pthread_create(&thread, NULL, playScript, NULL) != 0) return 0;
+    pthread_detach(thread);
+
+    return 1;
+}
+
+void halMaskInput(int masked) {
+    if (masked) pthread_mutex_lock(&inputLock);
+    else pthread_mutex_unlock(&inputLock);
+}
+
+void halSleepUntilInterrupt(int (*ready)()) {
+    pthread_mutex_lock(&inputLock);
+    if (!ready() && scriptDone < scriptLength) pthread_cond_wait(&interrupted, &inputLock);
+    pthread_mutex_unlock(&inputLock);
+}
+
+// Blank lines and lines from # on are skipped. Times only go forward.
+int halScriptInput(FILE *file) {
+
+    char line[256];
+    int capacity = 0;
+    uint32_t last = 0;
+
+    scriptLength = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+
+        unsigned long ms;
+        long b, s;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        int fields = sscanf(line, "%lu %li %li", &ms, &b, &s);
+        if (fields <= 0) continue;
+        if (fields != 3 || ms < last) return 0;
+
+        if (scriptLength == capacity) {
+            capacity = (capacity > 0 ? 2*capacity : 64);
+            script = (ScriptStep *) realloc(script, capacity*sizeof(ScriptStep));
+            if (script == NULL) return 0;
+        }
+
+        script[scriptLength++] = (ScriptStep){(uint32_t)ms, (uint32_t)b, (uint32_t)s};
+        last = (uint32_t)ms;
+    }
+
+    return (scriptLength > 0);
+}
+
+int halInputOver() {
+    return (script != NULL && scriptDone == scriptLength);
+}
+
+void halSimulateButtons(uint32_t value) {
+    buttons = value;
+}
+
+void halSimulateSwitches(uint32_t value) {
+    switches = value;
+}
+
+uint32_t halLEDs() {
+    return leds;
+}
+
+// "C4SL" and the words per frame, then the frames.
+void halRecordShapes(FILE *file) {
+
+    uint32_t words = kHOST_SHAPE_SLOTS;
+
+    recording = file;
+    if (recording != NULL) {
+        fwrite("C4SL", 1, 4, recording);
+        fwrite(&words, sizeof(words), 1, recording);
+    }
+}
+
+void halShapesFlushed() {
+    if (recording != NULL) fwrite(shapes, sizeof(uint32_t), kHOST_SHAPE_SLOTS, recording);
+}
@@ -0,0 +1,274 @@
+// Load test for GameServer: keeps -c games going at once on one connection,
+// playing random columns as fast as the CPUs answer, until -g games are
+// over. Prints the moves per second and the latency of the CPU answers as
+// this client sees them, then the server's own totals.
+//
+//   LoadTest [-u socket] [-c sessions] [-g games] [-e easy|hard|expert] [-s seed]
+
+#include "Bitboard.h"
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define kLINE_LENGTH        128
+#define kIN_BUFFER          65536
+
+// The client moves first
+#define kME                 0
+#define kCPU                1
+
+typedef struct {
+    Position pos;
+    XTime tAsked;
+} ClientGame;
+
+static int server;
+static char *out;
+static size_t outLength, outCapacity;
+
+static ClientGame *games;
+static int gamesCapacity;
+
+static uint64_t seed = 1;
+static double *latencies;           // In microseconds, one per CPU answer
+static uint32_t nLatencies, latenciesCapacity;
+
+static void sendLine(const char *format, ...);
+static void flushOutput();
+static ClientGame* gameFor(int id);
+static void playRandom(int id);
+static void addLatency(double micros);
+static int compareLatencies(const void *a, const void *b);
+
+int main(int argc, char *argv[]) {
+
+    const char *path = "/tmp/connect4.sock";
+    const char *cpu = "hard";
+    int concurrent = 100, total = 1000, i;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-u") == 0 && i+1 < argc) path = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) concurrent = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-g") == 0 && i+1 < argc) total = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-e") == 0 && i+1 < argc) cpu = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else break;
+    }
+
+    if (i < argc || concurrent < 1 || total < 1 || seed == 0) {
+        fprintf(stderr, "usage: %s [-u socket] [-c sessions] [-g games] [-e easy|hard|expert] [-s seed]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || connect(server, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror(path);
+        return 1;
+    }
+    fcntl(server, F_SETFL, O_NONBLOCK);
+
+    char in[kIN_BUFFER];
+    int inLength = 0;
+    int started = 0, finished = 0, moves = 0;
+    BOOL askedServer = false;
+    XTime tStart, tEnd;
+
+    XTime_GetTime(&tStart);
+
+    for (started=0; started<concurrent && started<total; ++started) sendLine("new %s\n", cpu);
+
+    while (true) {
+
+        struct pollfd fd;
+        fd.fd = server;
+        fd.events = POLLIN | (outLength > 0 ? POLLOUT : 0);
+
+        if (poll(&fd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+
+        if (fd.revents & POLLOUT) flushOutput();
+        if (!(fd.revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+        ssize_t n = read(server, in +inLength, sizeof(in) -inLength);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            fprintf(stderr, "server closed the connection\n");
+            return 1;
+        }
+        if (n < 0) continue;
+        inLength += (int)n;
+
+        char *start = in;
+        char *end;
+
+        while ((end = memchr(start, '\n', in +inLength -start)) != NULL) {
+
+            *end = '\0';
+
+            char word[16], result[16];
+            int id, col;
+
+            if (strncmp(start, "server ", 7) == 0) {
+                XTime_GetTime(&tEnd);
+                double seconds = (double)(tEnd -tStart) /COUNTS_PER_SECOND;
+
+                qsort(latencies, nLatencies, sizeof(double), compareLatencies);
+                double sum = 0;
+                uint32_t k;
+                for (k=0; k<nLatencies; ++k) sum += latencies[k];
+
+                printf("games %d, moves %d in %.2f s: %.0f moves/s\n", finished, moves, seconds, moves /seconds);
+                if (nLatencies > 0) {
+                    printf("latency us: mean %.0f, p50 %.0f, p99 %.0f, max %.0f\n", sum /nLatencies,
+                           latencies[nLatencies/2], latencies[(nLatencies*99 +99)/100 -1], latencies[nLatencies -1]);
+                }
+                printf("%s\n", start);
+                return 0;
+
+            } else if (sscanf(start, "ok %d", &id) == 1) {
+                memset(gameFor(id), 0, sizeof(ClientGame));
+                playRandom(id);
+
+            } else if (sscanf(start, "move %d %d", &id, &col) == 2) {
+                ClientGame *game = gameFor(id);
+                XTime now;
+                XTime_GetTime(&now);
+                addLatency((double)(now -game->tAsked)*1000000.0 /COUNTS_PER_SECOND);
+                ++moves;
+                --col;
+                // If the CPU ended the game, "end" follows
+                BOOL wins = positionIsWinningMove(&game->pos, col, kCPU);
+                positionPlay(&game->pos, col, kCPU);
+                if (!wins && game->pos.nMoves < kBOARDS_CELLS) playRandom(id);
+
+            } else if (sscanf(start, "end %d %15s", &id, result) == 2) {
+                sendLine("close %d\n", id);
+                ++finished;
+                if (started < total) {
+                    sendLine("new %s\n", cpu);
+                    ++started;
+                } else if (finished == total && !askedServer) {
+                    sendLine("server\n");
+                    askedServer = true;
+                }
+
+            } else if (sscanf(start, "%15s", word) == 1 && strcmp(word, "closed") != 0) {
+                fprintf(stderr, "%s\n", start);
+            }
+
+            start = end +1;
+        }
+
+        inLength -= (int)(start -in);
+        memmove(in, start, inLength);
+
+        flushOutput();
+    }
+}
+
+// Appends to the output, written by flushOutput() when the server takes it.
+static void sendLine(const char *format, ...) {
+
+    char line[kLINE_LENGTH];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (outLength +n > outCapacity) {
+        outCapacity = (outCapacity == 0 ? kIN_BUFFER : outCapacity*2);
+        out = (char *) realloc(out, outCapacity);
+        if (out == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    memcpy(out +outLength, line, n);
+    outLength += n;
+}
+
+static void flushOutput() {
+
+    while (outLength > 0) {
+
+        ssize_t n = write(server, out, outLength);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) return;
+            perror("write");
+            exit(1);
+        }
+
+        memmove(out, out +n, outLength -n);
+        outLength -= n;
+    }
+}
+
+// Ids are the server's slots, so they stay below its session count.
+static ClientGame* gameFor(int id) {
+
+    if (id >= gamesCapacity) {
+        int capacity = (gamesCapacity == 0 ? 1024 : gamesCapacity);
+        while (capacity <= id) capacity *= 2;
+        games = (ClientGame *) realloc(games, capacity*sizeof(ClientGame));
+        if (games == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        memset(games +gamesCapacity, 0, (capacity -gamesCapacity)*sizeof(ClientGame));
+        gamesCapacity = capacity;
+    }
+
+    return &games[id];
+}
+
+static void playRandom(int id) {
+
+    ClientGame *game = gameFor(id);
+    int col;
+
+    do {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        col = (int)(seed %kBOARDS_COLS);
+    } while (!positionCanPlay(&game->pos, col));
+
+    positionPlay(&game->pos, col, kME);
+    XTime_GetTime(&game->tAsked);
+    sendLine("play %d %d\n", id, col +1);
+}
+
+static void addLatency(double micros) {
+
+    if (nLatencies == latenciesCapacity) {
+        latenciesCapacity = (latenciesCapacity == 0 ? 65536 : latenciesCapacity*2);
+        latencies = (double *) realloc(latencies, latenciesCapacity*sizeof(double));
+        if (latencies == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    latencies[nLatencies++] = micros;
+}
+
+static int compareLatencies(const void *a, const void *b) {
+    double ta = *(const double *)a;
+    double tb = *(const double *)b;
+    return (ta > tb) - (ta < tb);
+}
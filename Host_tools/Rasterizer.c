@@ -0,0 +1,168 @@
+// Mirrors DRAW_SHAPES and DRAW_GRID in Connect4_procedures.vhd. Instead of
+// asking every shape about every pixel, each glyph row is kept as runs of
+// lit pixels and filled with memset(), which libc does with vector stores.
+
+#include "Rasterizer.h"
+#include <string.h>
+
+#define kSHAPE_TYPES        39
+#define kSHAPE_SIZE         15      // SHAPE_W, SHAPE_H
+#define kMAX_SPANS          8       // Per row of 15 pixels
+
+// DRAW_GRID
+#define kGRID_X_MARGIN      30
+#define kGRID_Y_MARGIN      50
+#define kGRID_STROKE        15
+#define kGRID_BOX           45
+#define kGRID_COLOR         BLUE
+
+// The ROM of DRAW_SHAPES, one row per entry, bit 14 is the leftmost pixel
+static const uint16_t kGLYPHS[kSHAPE_TYPES][kSHAPE_SIZE] = {
+    {0x0000, 0x0000, 0x03E0, 0x0770, 0x0630, 0x0670, 0x06F0, 0x07B0, 0x0730, 0x0630, 0x0630, 0x03E0, 0x01C0, 0x0000, 0x0000}, // '0'
+    {0x0000, 0x0000, 0x00C0, 0x03C0, 0x07C0, 0x00C0, 0x00C0, 0x00C0, 0x00C0, 0x00C0, 0x00C0, 0x03F0, 0x03F0, 0x0000, 0x0000}, // '1'
+    {0x0000, 0x0000, 0x03E0, 0x0370, 0x0030, 0x0030, 0x0060, 0x0060, 0x00C0, 0x0180, 0x0300, 0x07F0, 0x07F0, 0x0000, 0x0000}, // '2'
+    {0x0000, 0x0000, 0x07E0, 0x03E0, 0x00E0, 0x00C0, 0x01C0, 0x01E0, 0x0030, 0x0030, 0x0070, 0x07E0, 0x03C0, 0x0000, 0x0000}, // '3'
+    {0x0000, 0x0000, 0x0060, 0x00E0, 0x01E0, 0x01E0, 0x0360, 0x0660, 0x0FF8, 0x07F0, 0x0060, 0x0060, 0x0060, 0x0000, 0x0000}, // '4'
+    {0x0000, 0x0000, 0x03F0, 0x03E0, 0x0300, 0x0300, 0x03C0, 0x01E0, 0x0030, 0x0030, 0x0070, 0x07E0, 0x03C0, 0x0000, 0x0000}, // '5'
+    {0x0000, 0x0000, 0x00E0, 0x01C0, 0x0300, 0x0600, 0x07E0, 0x07F0, 0x0630, 0x0630, 0x0630, 0x03E0, 0x01C0, 0x0000, 0x0000}, // '6'
+    {0x0000, 0x0000, 0x07F0, 0x07F0, 0x0060, 0x0060, 0x00C0, 0x00C0, 0x0180, 0x0180, 0x0300, 0x0300, 0x0200, 0x0000, 0x0000}, // '7'
+    {0x0000, 0x0000, 0x03E0, 0x0770, 0x0630, 0x0730, 0x03E0, 0x03E0, 0x0670, 0x0630, 0x0630, 0x07E0, 0x01C0, 0x0000, 0x0000}, // '8'
+    {0x0000, 0x0000, 0x03E0, 0x0770, 0x0630, 0x0630, 0x0630, 0x03F0, 0x00B0, 0x0060, 0x00E0, 0x03C0, 0x0300, 0x0000, 0x0000}, // '9'
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x01C0, 0x01C0, 0x0000, 0x0000, 0x0000, 0x01C0, 0x01C0, 0x0000, 0x0000, 0x0000}, // ':'
+    {0x0000, 0x0000, 0x0730, 0x0F60, 0x0DE0, 0x0FC0, 0x07C0, 0x01F0, 0x01F8, 0x03D8, 0x03D8, 0x0670, 0x0220, 0x0000, 0x0000}, // '%', drawn for '?'
+    {0x0000, 0x0000, 0x01C0, 0x01C0, 0x01C0, 0x0360, 0x0360, 0x0360, 0x07F0, 0x07F0, 0x0630, 0x0C18, 0x0C18, 0x0000, 0x0000}, // 'A'
+    {0x0000, 0x0000, 0x07E0, 0x07F0, 0x0630, 0x0630, 0x07E0, 0x07F0, 0x0630, 0x0630, 0x0630, 0x07F0, 0x03C0, 0x0000, 0x0000}, // 'B'
+    {0x0000, 0x0000, 0x01F0, 0x03F0, 0x0730, 0x0600, 0x0600, 0x0600, 0x0600, 0x0610, 0x0710, 0x03F0, 0x00E0, 0x0000, 0x0000}, // 'C'
+    {0x0000, 0x0000, 0x07C0, 0x07E0, 0x0630, 0x0630, 0x0630, 0x0638, 0x0630, 0x0630, 0x0670, 0x07E0, 0x0780, 0x0000, 0x0000}, // 'D'
+    {0x0000, 0x0000, 0x07F0, 0x07F0, 0x0600, 0x0600, 0x07E0, 0x07F0, 0x0600, 0x0600, 0x0600, 0x07F0, 0x03F0, 0x0000, 0x0000}, // 'E'
+    {0x0000, 0x0000, 0x03F0, 0x07F0, 0x0600, 0x0600, 0x07E0, 0x07F0, 0x0600, 0x0600, 0x0600, 0x0600, 0x0200, 0x0000, 0x0000}, // 'F'
+    {0x0000, 0x0000, 0x01F0, 0x03F0, 0x0630, 0x0600, 0x0600, 0x06F0, 0x0670, 0x0630, 0x0730, 0x03F0, 0x01E0, 0x0000, 0x0000}, // 'G'
+    {0x0000, 0x0000, 0x0630, 0x0630, 0x0630, 0x0630, 0x07F0, 0x07F0, 0x0630, 0x0630, 0x0630, 0x0630, 0x0410, 0x0000, 0x0000}, // 'H'
+    {0x0000, 0x0000, 0x07F0, 0x07F0, 0x0080, 0x0080, 0x0080, 0x0080, 0x0080, 0x0080, 0x0080, 0x07F0, 0x07F0, 0x0000, 0x0000}, // 'I'
+    {0x0000, 0x0000, 0x07F0, 0x03F0, 0x0030, 0x0030, 0x0030, 0x0030, 0x0030, 0x0030, 0x0060, 0x07E0, 0x03C0, 0x0000, 0x0000}, // 'J'
+    {0x0000, 0x0000, 0x0630, 0x0630, 0x0660, 0x06C0, 0x07C0, 0x07C0, 0x06C0, 0x0660, 0x0670, 0x0638, 0x0618, 0x0000, 0x0000}, // 'K'
+    {0x0000, 0x0000, 0x0600, 0x0600, 0x0600, 0x0600, 0x0600, 0x0600, 0x0610, 0x0630, 0x0630, 0x07F0, 0x07F0, 0x0000, 0x0000}, // 'L'
+    {0x0000, 0x0000, 0x0630, 0x0630, 0x0770, 0x07F0, 0x07F0, 0x06B0, 0x0630, 0x0630, 0x0630, 0x0630, 0x0410, 0x0000, 0x0000}, // 'M'
+    {0x0000, 0x0000, 0x0630, 0x0630, 0x0730, 0x07B0, 0x07B0, 0x06F0, 0x06F0, 0x0670, 0x0670, 0x0630, 0x0410, 0x0000, 0x0000}, // 'N'
+    {0x0000, 0x0000, 0x03E0, 0x07F0, 0x0630, 0x0630, 0x0630, 0x0E38, 0x0630, 0x0630, 0x0630, 0x03E0, 0x01C0, 0x0000, 0x0000}, // 'O'
+    {0x0000, 0x0000, 0x07E0, 0x07F0, 0x0630, 0x0630, 0x0630, 0x07E0, 0x07C0, 0x0600, 0x0600, 0x0600, 0x0200, 0x0000, 0x0000}, // 'P'
+    {0x0000, 0x0000, 0x03E0, 0x07F0, 0x0630, 0x0630, 0x0630, 0x0E38, 0x0630, 0x0630, 0x0630, 0x03E0, 0x01C0, 0x00F0, 0x0070}, // 'Q'
+    {0x0000, 0x0000, 0x07E0, 0x07F0, 0x0630, 0x0630, 0x06E0, 0x07C0, 0x0660, 0x0660, 0x0630, 0x0630, 0x0210, 0x0000, 0x0000}, // 'R'
+    {0x0000, 0x0000, 0x03F0, 0x07F0, 0x0630, 0x0700, 0x03C0, 0x01E0, 0x0070, 0x0630, 0x0630, 0x07F0, 0x03C0, 0x0000, 0x0000}, // 'S'
+    {0x0000, 0x0000, 0x0FF8, 0x0FF8, 0x0C98, 0x0080, 0x0080, 0x0080, 0x0080, 0x0080, 0x0080, 0x03E0, 0x03E0, 0x0000, 0x0000}, // 'T'
+    {0x0000, 0x0000, 0x0630, 0x0630, 0x0630, 0x0630, 0x0630, 0x0630, 0x0630, 0x0630, 0x0630, 0x07F0, 0x01C0, 0x0000, 0x0000}, // 'U'
+    {0x0000, 0x0000, 0x0C18, 0x0C18, 0x0630, 0x0630, 0x0630, 0x0360, 0x0360, 0x03E0, 0x01C0, 0x01C0, 0x0080, 0x0000, 0x0000}, // 'V'
+    {0x0000, 0x0000, 0x0C18, 0x0C18, 0x0C18, 0x0C98, 0x07D0, 0x07F0, 0x07F0, 0x0770, 0x0770, 0x0770, 0x0220, 0x0000, 0x0000}, // 'W'
+    {0x0000, 0x0000, 0x0630, 0x0630, 0x0360, 0x03E0, 0x01C0, 0x01C0, 0x01E0, 0x0360, 0x0630, 0x0638, 0x0410, 0x0000, 0x0000}, // 'X'
+    {0x0000, 0x0000, 0x0C18, 0x0630, 0x0630, 0x0360, 0x03E0, 0x01C0, 0x01C0, 0x01C0, 0x01C0, 0x01C0, 0x0080, 0x0000, 0x0000}, // 'Y'
+    {0x0000, 0x0000, 0x07F0, 0x07F0, 0x0070, 0x0060, 0x00C0, 0x0180, 0x0380, 0x0300, 0x0600, 0x07F0, 0x07F0, 0x0000, 0x0000}, // 'Z'
+    {0x03E0, 0x0FF8, 0x1FFC, 0x3FFE, 0x3FFE, 0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF, 0x3FFE, 0x3FFE, 0x1FFC, 0x0FF8, 0x03E0}, // ball
+};
+
+typedef struct {
+    uint8_t start, length;
+} Span;
+
+static Span spans[kSHAPE_TYPES][kSHAPE_SIZE][kMAX_SPANS];
+static uint8_t nSpans[kSHAPE_TYPES][kSHAPE_SIZE];
+
+static void fillSpan(uint8_t frame[], int x, int y, int length, uint8_t color);
+static void drawShape(uint32_t word, uint8_t frame[]);
+static void drawGrid(uint8_t frame[]);
+
+void rasterizerInit() {
+
+    int t, r, x;
+
+    for (t=0; t<kSHAPE_TYPES; ++t) {
+        for (r=0; r<kSHAPE_SIZE; ++r) {
+
+            nSpans[t][r] = 0;
+
+            for (x=0; x<kSHAPE_SIZE; ) {
+
+                if (!(kGLYPHS[t][r] >> (kSHAPE_SIZE -1 -x) & 1)) {
+                    ++x;
+                    continue;
+                }
+
+                Span *span = &spans[t][r][nSpans[t][r]++];
+                span->start = x;
+                while (x<kSHAPE_SIZE && (kGLYPHS[t][r] >> (kSHAPE_SIZE -1 -x) & 1)) ++x;
+                span->length = x -span->start;
+            }
+        }
+    }
+}
+
+void rasterizeShapes(const uint32_t words[], int count, uint8_t frame[kFRAME_PIXELS]) {
+
+    int i;
+
+    memset(frame, BLACK, kFRAME_PIXELS);
+
+    if (count > kRASTER_SHAPES +1) count = kRASTER_SHAPES +1;
+
+    // Where shapes overlap the first one is shown, so they're painted last
+    // to first. The grid covers them all.
+    for (i=count -1; i>=1; --i) drawShape(words[i], frame);
+
+    if (count > 0 && (words[0] & 1)) drawGrid(frame);
+}
+
+// Clipped to the frame
+static void fillSpan(uint8_t frame[], int x, int y, int length, uint8_t color) {
+
+    if (y < 0 || y >= kFRAME_HEIGHT) return;
+    if (x < 0) {
+        length += x;
+        x = 0;
+    }
+    if (x +length > kFRAME_WIDTH) length = kFRAME_WIDTH -x;
+    if (length <= 0) return;
+
+    memset(frame +y*kFRAME_WIDTH +x, color, length);
+}
+
+static void drawShape(uint32_t word, uint8_t frame[]) {
+
+    int type = (word >> 2) & 0xFF;
+
+    if (word == 0 || type >= kSHAPE_TYPES) return;
+
+    // The position is the center
+    int left = (int)(word >> 22) -kSHAPE_SIZE/2;
+    int top = (int)((word >> 13) & 0x1FF) -kSHAPE_SIZE/2;
+    uint8_t color = (word >> 10) & 0b111;
+    int r, s;
+
+    for (r=0; r<kSHAPE_SIZE; ++r) {
+        for (s=0; s<nSpans[type][r]; ++s) {
+            fillSpan(frame, left +spans[type][r][s].start, top +r, spans[type][r][s].length, color);
+        }
+    }
+}
+
+// Strokes leave out the pixels on their edges, as the strict comparisons of
+// DRAW_GRID do.
+static void drawGrid(uint8_t frame[]) {
+
+    const int pitch = kGRID_STROKE +kGRID_BOX;
+    const int width = kGRID_STROKE*(kBOARDS_COLS +1) +kGRID_BOX*kBOARDS_COLS;
+    const int height = kGRID_STROKE*(kBOARDS_ROWS +1) +kGRID_BOX*kBOARDS_ROWS;
+    int y, k;
+
+    for (y=kGRID_Y_MARGIN +1; y<kGRID_Y_MARGIN +height; ++y) {
+
+        int inRow = (y -kGRID_Y_MARGIN) %pitch;
+
+        if (inRow > 0 && inRow < kGRID_STROKE && (y -kGRID_Y_MARGIN)/pitch <= kBOARDS_ROWS) {
+            // Horizontal stroke
+            fillSpan(frame, kGRID_X_MARGIN +1, y, width -1, kGRID_COLOR);
+        } else {
+            for (k=0; k<=kBOARDS_COLS; ++k) {
+                fillSpan(frame, kGRID_X_MARGIN +k*pitch +1, y, kGRID_STROKE -1, kGRID_COLOR);
+            }
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef RASTERIZER
+#define RASTERIZER
+
+#include "Constants.h"
+
+// Software model of the VGA controller (VHDL_design): draws a shape list,
+// as the game leaves it in halShapeBuffer(), into a 640x480 frame of one
+// byte per pixel holding the 3-bit color (RED, GREEN, ...; BLACK is the
+// background).
+
+#define kFRAME_WIDTH        640
+#define kFRAME_HEIGHT       480
+#define kFRAME_PIXELS       (kFRAME_WIDTH *kFRAME_HEIGHT)
+
+// Shapes read after the grid word: N_MAX_SHAPES of the VGA design, plus
+// one per extra disc of a bigger board
+#define kRASTER_SHAPES      (49 +kBOARDS_CELLS -7*6)
+
+// Builds the span tables of the glyphs, before the first frame
+void rasterizerInit();
+
+// words[0] turns the grid on, words[1..count-1] are shapes (encodeShape()).
+// Words past kRASTER_SHAPES aren't drawn, as on the board.
+void rasterizeShapes(const uint32_t words[], int count, uint8_t frame[kFRAME_PIXELS]);
+
+#endif
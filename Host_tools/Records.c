@@ -0,0 +1,262 @@
+// Reads game records written with connect4_headless -g (see GameRecord.h)
+// and prints, for every kind of player, its games, results and mean think
+// time per move. -l also lists the games, one per line: the players, who
+// moved first, the result and the columns played, from 1 as in the position
+// sets, so that they can go to Analyze or Tournament -o. -n reads the file
+// n times, to time the reader.
+//
+// -p plays the games back instead: from each game's seed and mistake rates,
+// every CPU move is searched again, as the game did, and checked against the
+// record. The EASY and HARD CPUs must find the same columns, bit for bit;
+// the EXPERT searches against the clock, so its columns may differ, and the
+// recorded ones are played. Prints the moves that differ and the time the
+// CPUs took, to compare builds on the very same games. Exits with 2 if any
+// EASY or HARD move differs. Games played with an opening book play back
+// with the same book, -b.
+//
+//   Records [-l] [-n times] records
+//   Records -p [-b book.bin] records
+
+#include "AI.h"
+#include "Bitboard.h"
+#include "GameRecord.h"
+#include <string.h>
+
+typedef struct {
+    char player;
+    uint64_t games, wins, losses, ties, abandoned;
+    uint64_t moves, micros;
+} PlayerTotals;
+
+#define kRECORD_PLAYER_KINDS 8
+
+static PlayerTotals* totalsFor(PlayerTotals totals[], int *count, char player);
+static void listGame(const GameRecord *game);
+static int playBack(RecordReader *reader);
+static void boardFromPosition(Board *board, const Position *pos, const char players[]);
+
+int main(int argc, char *argv[]) {
+
+    BOOL list = false, replay = false;
+    int times = 1, i;
+    const char *bookPath = NULL;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-l") == 0) list = true;
+        else if (strcmp(argv[i], "-p") == 0) replay = true;
+        else if (strcmp(argv[i], "-n") == 0 && i+1 < argc) times = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) bookPath = argv[++i];
+        else break;
+    }
+
+    if (i != argc -1 || times < 1 || (replay && (list || times > 1)) || (bookPath != NULL && !replay)) {
+        fprintf(stderr, "usage: %s [-l] [-n times] records\n", argv[0]);
+        fprintf(stderr, "       %s -p [-b book.bin] records\n", argv[0]);
+        return 1;
+    }
+
+#ifdef USE_MMAP
+    static OpeningBook book;
+
+    if (bookPath != NULL) {
+        if (!bookOpen(&book, bookPath)) {
+            fprintf(stderr, "can't open %s\n", bookPath);
+            return 1;
+        }
+        setCPUsOpeningBook(&book);
+    }
+#else
+    if (bookPath != NULL) {
+        fprintf(stderr, "opening books need a build with USE_MMAP\n");
+        return 1;
+    }
+#endif
+
+    RecordReader reader;
+    if (!recordReaderOpen(&reader, argv[i])) {
+        fprintf(stderr, "%s: not a record file of %dx%d, %d to win\n", argv[i], kBOARDS_COLS, kBOARDS_ROWS, kLEN_TO_WIN);
+        return 1;
+    }
+
+    if (replay) {
+        int status = playBack(&reader);
+        recordReaderClose(&reader);
+        return status;
+    }
+
+    const uint8_t *first = reader.next;
+    PlayerTotals totals[kRECORD_PLAYER_KINDS];
+    int nPlayers = 0, t;
+    uint64_t games = 0, moves = 0;
+    GameRecord game;
+    XTime tStart, tEnd;
+
+    XTime_GetTime(&tStart);
+    for (t=0; t<times; ++t) {
+        reader.next = first;
+        games = moves = 0;
+        nPlayers = 0;
+
+        while (recordNext(&reader, &game)) {
+            int p, m;
+
+            ++games;
+            moves += game.nMoves;
+
+            for (p=0; p<2; ++p) {
+                PlayerTotals *pt = totalsFor(totals, &nPlayers, game.players[p]);
+                ++pt->games;
+                if (game.result == RecordResultTie) ++pt->ties;
+                else if (game.result == RecordResultAbandoned) ++pt->abandoned;
+                else if (game.result == (p == 0 ? RecordResultFirstPlayer : RecordResultSecondPlayer)) ++pt->wins;
+                else ++pt->losses;
+
+                // Moves alternate from game.first
+                for (m=(p == game.first ? 0 : 1); m<game.nMoves; m+=2) {
+                    ++pt->moves;
+                    pt->micros += recordUnpackMicros(game.times[m]);
+                }
+            }
+
+            if (list && t == 0) listGame(&game);
+        }
+    }
+    XTime_GetTime(&tEnd);
+
+    if (reader.next != reader.end) fprintf(stderr, "the last game is cut short\n");
+
+    printf("games %llu, moves %llu\n", (unsigned long long)games, (unsigned long long)moves);
+    for (t=0; t<nPlayers; ++t) {
+        PlayerTotals *pt = &totals[t];
+        printf("%c  games %llu  won %llu  lost %llu  tied %llu  abandoned %llu  think %.3f ms/move\n", pt->player,
+               (unsigned long long)pt->games, (unsigned long long)pt->wins, (unsigned long long)pt->losses,
+               (unsigned long long)pt->ties, (unsigned long long)pt->abandoned,
+               (pt->moves > 0 ? pt->micros /1000.0 /pt->moves : 0));
+    }
+
+    double seconds = (double)(tEnd -tStart) /COUNTS_PER_SECOND;
+    size_t bytes = (size_t)(reader.end -first);
+    fprintf(stderr, "read %llu games %d times in %.3f s: %.0f games/s, %.0f MB/s\n", (unsigned long long)games, times,
+            seconds, (seconds > 0 ? games*(double)times /seconds : 0), (seconds > 0 ? bytes*(double)times /seconds /1e6 : 0));
+
+    recordReaderClose(&reader);
+
+    return 0;
+}
+
+static PlayerTotals* totalsFor(PlayerTotals totals[], int *count, char player) {
+
+    int i;
+
+    for (i=0; i<*count; ++i) {
+        if (totals[i].player == player) return &totals[i];
+    }
+    if (i == kRECORD_PLAYER_KINDS) return &totals[i -1];     // A damaged file
+
+    memset(&totals[i], 0, sizeof(PlayerTotals));
+    totals[i].player = player;
+    ++*count;
+    return &totals[i];
+}
+
+static void listGame(const GameRecord *game) {
+
+    static const char *results[] = {"1-0", "0-1", "tie", "abandoned"};
+    char columns[kBOARDS_CELLS +1];
+    int m;
+
+    for (m=0; m<game->nMoves; ++m) columns[m] = '1' +recordMoveAt(game, m);
+    columns[m] = '\0';
+
+    printf("%c%c %d %-9s %s\n", game->players[0], game->players[1], game->first, results[game->result <= RecordResultAbandoned ? game->result : RecordResultAbandoned], columns);
+}
+
+// The CPU calls of Connect4.c's newGame(), in the same order, on the same
+// boards. Two CPUs of the same kind (Tournament games) see the other's discs
+// as kPLAYER_2's, as Tournament shows them.
+static int playBack(RecordReader *reader) {
+
+    uint64_t games = 0, searched = 0, differ = 0, expertDiffer = 0;
+    XTime spent = 0;
+    GameRecord game;
+
+    initZobristKeys();
+    CPUsReserve();
+
+    while (recordNext(reader, &game)) {
+
+        Position pos;
+        Board board;
+        int m;
+
+        memset(&pos, 0, sizeof(Position));
+        setCPUsSeed(game.seed);
+
+        for (m=0; m<game.nMoves; ++m) {
+
+            int turn = (game.first +m)%2;
+            int col = recordMoveAt(&game, m);
+            char cpu = game.players[turn];
+
+            if (col >= kBOARDS_COLS || !positionCanPlay(&pos, col)) {
+                fprintf(stderr, "game %llu, move %d: column %d can't be played\n", (unsigned long long)games, m, col +1);
+                return 1;
+            }
+
+            if (m >= game.openingMoves && (cpu == kCPU_EASY || cpu == kCPU_HARD || cpu == kCPU_EXPERT)) {
+
+                char players[2] = {game.players[0], game.players[1]};
+                if (players[0] == players[1]) players[(turn +1)%2] = kPLAYER_2;
+                boardFromPosition(&board, &pos, players);
+
+                XTime tStart, tEnd;
+                int answer;
+
+                BOOL isDemo = (game.mistakes[turn] > 0);
+                setCPUsMistakes(game.mistakes[turn]);
+
+                XTime_GetTime(&tStart);
+                if (cpu == kCPU_EXPERT) answer = CPUsChoiceWithinTime(&board, players, turn, game.settings[turn], isDemo, NULL);
+                else answer = CPUsChoice(&board, players, turn, (game.settings[turn] > 0 ? game.settings[turn] : 1), isDemo);
+                XTime_GetTime(&tEnd);
+
+                spent += tEnd -tStart;
+                ++searched;
+
+                if (answer != col) {
+                    printf("game %llu, move %d: %c played %d, now %d\n", (unsigned long long)games, m, cpu, col +1, answer +1);
+                    if (cpu == kCPU_EXPERT) ++expertDiffer;
+                    else ++differ;
+                }
+            }
+
+            positionPlay(&pos, col, turn);
+        }
+
+        ++games;
+    }
+
+    double seconds = (double)spent /COUNTS_PER_SECOND;
+    printf("games %llu, CPU moves %llu in %.3f s, %llu differ (%llu of the EXPERT)\n", (unsigned long long)games,
+           (unsigned long long)searched, seconds, (unsigned long long)(differ +expertDiffer), (unsigned long long)expertDiffer);
+
+    return (differ > 0 ? 2 : 0);
+}
+
+// The board the game would show for the same moves, with players[0] first.
+static void boardFromPosition(Board *board, const Position *pos, const char players[]) {
+
+    int i, j;
+
+    board->emptyCells = kBOARDS_CELLS -pos->nMoves;
+    board->n_balls = pos->nMoves;
+
+    for (i=0; i<kBOARDS_ROWS; ++i) {
+        for (j=0; j<kBOARDS_COLS; ++j) {
+            int row = kBOARDS_ROWS -1 -i;
+            if (pos->discs[0] & bitForCell(j, row)) board->matrix[i][j] = players[0];
+            else if (pos->discs[1] & bitForCell(j, row)) board->matrix[i][j] = players[1];
+            else board->matrix[i][j] = kEMPTY;
+        }
+    }
+}
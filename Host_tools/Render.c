@@ -0,0 +1,135 @@
+// Renders shape lists recorded with connect4_headless -r into 640x480
+// frames, the way the VGA controller would draw them. Frames go to a PPM
+// sequence (-p: prefix00000.ppm, ...), to one file of raw RGB24 frames
+// (-o, "-" for stdout; ffmpeg -f rawvideo -pix_fmt rgb24 -s 640x480) and/or
+// as a hash per frame on stdout (-c), to compare renders at volume.
+// -n draws every frame n times, to time the rasterizer.
+//
+//   Render [-p prefix] [-o raw] [-c] [-n times] [shapes]
+
+#include "Rasterizer.h"
+#include <string.h>
+
+static void writeRGB(FILE *file, const uint8_t frame[]);
+static uint64_t hashFrame(const uint8_t frame[]);
+
+int main(int argc, char *argv[]) {
+
+    const char *prefix = NULL, *rawPath = NULL;
+    BOOL hashes = false;
+    int times = 1, i;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-p") == 0 && i+1 < argc) prefix = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) rawPath = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0) hashes = true;
+        else if (strcmp(argv[i], "-n") == 0 && i+1 < argc) times = atoi(argv[++i]);
+        else break;
+    }
+
+    if (i < argc -1 || times < 1 || (i < argc && argv[i][0] == '-' && argv[i][1] != '\0')) {
+        fprintf(stderr, "usage: %s [-p prefix] [-o raw] [-c] [-n times] [shapes]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = (i < argc && strcmp(argv[i], "-") != 0 ? fopen(argv[i], "rb") : stdin);
+    if (in == NULL) {
+        perror(argv[i]);
+        return 1;
+    }
+
+    FILE *raw = NULL;
+    if (rawPath != NULL) {
+        raw = (strcmp(rawPath, "-") == 0 ? stdout : fopen(rawPath, "wb"));
+        if (raw == NULL) {
+            perror(rawPath);
+            return 1;
+        }
+    }
+
+    char magic[4];
+    uint32_t count;
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, "C4SL", 4) != 0 || fread(&count, sizeof(count), 1, in) != 1 || count == 0) {
+        fprintf(stderr, "not a shape recording\n");
+        return 1;
+    }
+
+    uint32_t *words = (uint32_t *) malloc(count*sizeof(uint32_t));
+    uint8_t *frame = (uint8_t *) malloc(kFRAME_PIXELS);
+    if (words == NULL || frame == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    rasterizerInit();
+
+    uint32_t nFrames = 0;
+    XTime spent = 0;
+
+    while (fread(words, sizeof(uint32_t), count, in) == count) {
+
+        XTime tStart, tEnd;
+        int t;
+
+        XTime_GetTime(&tStart);
+        for (t=0; t<times; ++t) rasterizeShapes(words, (int)count, frame);
+        XTime_GetTime(&tEnd);
+        spent += tEnd -tStart;
+
+        if (prefix != NULL) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s%05lu.ppm", prefix, (unsigned long)nFrames);
+            FILE *ppm = fopen(path, "wb");
+            if (ppm == NULL) {
+                perror(path);
+                return 1;
+            }
+            fprintf(ppm, "P6\n%d %d\n255\n", kFRAME_WIDTH, kFRAME_HEIGHT);
+            writeRGB(ppm, frame);
+            fclose(ppm);
+        }
+
+        if (raw != NULL) writeRGB(raw, frame);
+        if (hashes) printf("%lu %016llx\n", (unsigned long)nFrames, (unsigned long long)hashFrame(frame));
+
+        ++nFrames;
+    }
+
+    double seconds = (double)spent /COUNTS_PER_SECOND;
+    fprintf(stderr, "frames %lu, rasterized %lu times in %.3f s: %.0f frames/s\n", (unsigned long)nFrames,
+            (unsigned long)nFrames*times, seconds, (seconds > 0 ? nFrames*(double)times /seconds : 0));
+
+    if (raw != NULL && raw != stdout) fclose(raw);
+    if (in != stdin) fclose(in);
+
+    return 0;
+}
+
+// Color bit 0 is red, 1 green and 2 blue
+static void writeRGB(FILE *file, const uint8_t frame[]) {
+
+    static uint8_t rgb[kFRAME_PIXELS*3];
+    int p;
+
+    for (p=0; p<kFRAME_PIXELS; ++p) {
+        rgb[3*p] = (frame[p] & RED ? 255 : 0);
+        rgb[3*p +1] = (frame[p] & GREEN ? 255 : 0);
+        rgb[3*p +2] = (frame[p] & BLUE ? 255 : 0);
+    }
+
+    fwrite(rgb, 1, sizeof(rgb), file);
+}
+
+// FNV-1a
+static uint64_t hashFrame(const uint8_t frame[]) {
+
+    uint64_t hash = 14695981039346656037ULL;
+    int p;
+
+    for (p=0; p<kFRAME_PIXELS; ++p) {
+        hash ^= frame[p];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
@@ -0,0 +1,528 @@
+// Self-play tournament between engine configurations, on every core: each
+// worker process takes the next game from a shared counter until none are
+// left. Every opening is played twice per pairing, once with each engine
+// moving first. Openings come from a position set (-o, its first field,
+// e.g. positions/opening.txt) or are -n random ones of -p plies.
+//
+// An engine is type:setting[:error], e.g. easy:4, hard:7:20, expert:500:
+// the depth of EASY and HARD, the time budget in ms of the EXPERT, and an
+// optional 1 in error chance per move of playing a random column instead.
+//
+// Prints the Elo of every engine, with its 95% error bar, and what it costs:
+// CPU time and nodes per move searched. -G plays the first engine against
+// every other (gauntlet) instead of every pair (round robin). -g appends
+// the games to a record file (see GameRecord.h). -b gives the engines an
+// opening book, which EASY doesn't use, -x the EXPERT an endgame table.
+//
+//   Tournament [-G] [-j workers] [-o openings.txt | -n openings -p plies] [-s seed] [-m table_MB] [-g games.c4gr] [-b book.bin] [-x endgame.bin] engine...
+
+#include "AI.h"
+#include "Bitboard.h"
+#include "GameRecord.h"
+#include "Random.h"
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define nextPlayerIndex(_curr) ((_curr+1)%2)
+
+#define kMAX_ENGINES        16
+#define kMAX_OPENINGS       100000
+
+typedef struct {
+    const char *name;
+    char type;                      // kCPU_EASY, kCPU_HARD or kCPU_EXPERT
+    int setting;
+    int error;                      // 0 for no mistakes
+} Engine;
+
+typedef struct {
+    int engines[2];                 // engines[0] moves first
+    int opening;
+    uint64_t seed;                  // Of the engines' mistakes, as in a game of the board
+} Game;
+
+// Filled in by the worker that played the game
+typedef struct {
+    BOOL done;
+    int winner;                     // Index in the game's engines, -1 for a tie
+    int nMoves, openingMoves;
+    uint8_t moves[kBOARDS_CELLS];
+    uint32_t micros[kBOARDS_CELLS];
+    uint64_t cpuNanos[2], nodes[2];
+    int searched[2];                // Moves made by the engine, not the opening
+} GameResult;
+
+typedef struct {
+    double score, games;
+    double elo, error;
+    uint64_t cpuNanos, nodes, moves;
+} Standing;
+
+static Engine engines[kMAX_ENGINES];
+static int nEngines;
+static char (*openings)[kBOARDS_CELLS +1];
+static int nOpenings;
+
+static BOOL parseEngine(const char *spec, Engine *engine);
+static int loadOpenings(const char *path);
+static void randomOpenings(int count, int plies, Random *random);
+static void playGame(const Game *game, GameResult *result);
+static void boardFromPosition(Board *board, const Position *pos, const char players[]);
+static uint64_t cpuNanos();
+static void rate(const Game *games, const GameResult *results, int count, Standing standings[]);
+static void writeRecords(const char *path, const Game *games, const GameResult *results, int count);
+
+int main(int argc, char *argv[]) {
+
+    BOOL gauntlet = false;
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int count = 50, plies = 4, i, a, b, o, w;
+    uint64_t seed = 1;
+    Random random;                  // The random openings, then the games' seeds
+    size_t tableMB = 16;
+    const char *openingsPath = NULL, *recordsPath = NULL, *bookPath = NULL, *endgamePath = NULL;
+
+    for (i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-G") == 0) gauntlet = true;
+        else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) openingsPath = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i+1 < argc) count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && i+1 < argc) plies = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-m") == 0 && i+1 < argc) tableMB = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-g") == 0 && i+1 < argc) recordsPath = argv[++i];
+        else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) bookPath = argv[++i];
+        else if (strcmp(argv[i], "-x") == 0 && i+1 < argc) endgamePath = argv[++i];
+        else break;
+    }
+
+    for (; i<argc && nEngines < kMAX_ENGINES; ++i) {
+        if (!parseEngine(argv[i], &engines[nEngines])) break;
+        ++nEngines;
+    }
+
+    if (i < argc || nEngines < 2 || workers < 1 || count < 1 || plies < 0 || plies >= kBOARDS_CELLS) {
+        fprintf(stderr, "usage: %s [-G] [-j workers] [-o openings.txt | -n openings -p plies] [-s seed] [-m table_MB] [-g games.c4gr] [-b book.bin] [-x endgame.bin] engine...\n", argv[0]);
+        fprintf(stderr, "       engine: easy:depth[:error] | hard:depth[:error] | expert:ms[:error], %d at most\n", kMAX_ENGINES);
+        return 1;
+    }
+
+    initZobristKeys();
+    randomSeed(&random, seed);
+
+#ifdef USE_MMAP
+    // Mapped before the workers fork, so they all share them
+    static OpeningBook book;
+    static EndgameTable endgame;
+
+    if (bookPath != NULL) {
+        if (!bookOpen(&book, bookPath)) {
+            fprintf(stderr, "can't open %s\n", bookPath);
+            return 1;
+        }
+        setCPUsOpeningBook(&book);
+    }
+
+    if (endgamePath != NULL) {
+        if (!endgameOpen(&endgame, endgamePath)) {
+            fprintf(stderr, "can't open %s\n", endgamePath);
+            return 1;
+        }
+        setCPUsEndgameTable(&endgame);
+    }
+#else
+    if (bookPath != NULL || endgamePath != NULL) {
+        fprintf(stderr, "books and endgame tables need a build with USE_MMAP\n");
+        return 1;
+    }
+#endif
+
+    openings = malloc(kMAX_OPENINGS*sizeof(*openings));
+    if (openings == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    if (openingsPath != NULL) {
+        if (loadOpenings(openingsPath) <= 0) {
+            fprintf(stderr, "%s: no openings\n", openingsPath);
+            return 1;
+        }
+    } else {
+        randomOpenings(count < kMAX_OPENINGS ? count : kMAX_OPENINGS, plies, &random);
+    }
+
+    // Every pairing plays every opening with both colors
+    int pairings = (gauntlet ? nEngines -1 : nEngines*(nEngines -1)/2);
+    int nGames = pairings*nOpenings*2, g = 0;
+    Game *games = malloc(nGames*sizeof(Game));
+
+    // Shared with the workers: the next game to play, then the results
+    size_t sharedBytes = sizeof(int) +nGames*sizeof(GameResult);
+    void *shared = mmap(NULL, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (games == NULL || shared == MAP_FAILED) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    int *nextGame = (int *)shared;
+    GameResult *results = (GameResult *)((char *)shared +sizeof(int));
+
+    for (a=0; a<nEngines; ++a) {
+        for (b=a+1; b<nEngines; ++b) {
+            if (gauntlet && a != 0) continue;
+            for (o=0; o<nOpenings; ++o) {
+                games[g] = (Game){{a, b}, o, randomNext(&random)};
+                games[g+1] = (Game){{b, a}, o, randomNext(&random)};
+                g += 2;
+            }
+        }
+    }
+
+    fprintf(stderr, "%d engines, %d openings, %d games on %d workers\n", nEngines, nOpenings, nGames, workers);
+
+    struct timespec tStart, tEnd;
+    clock_gettime(CLOCK_MONOTONIC, &tStart);
+
+    for (w=0; w<workers; ++w) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            // Only the parent reports: the CPUs' mistakes would print here
+            if (freopen("/dev/null", "w", stdout) == NULL) _exit(1);
+            setCPUsMemoryBudget(tableMB*1024*1024);
+            CPUsReserve();
+            while ((g = __atomic_fetch_add(nextGame, 1, __ATOMIC_RELAXED)) < nGames) playGame(&games[g], &results[g]);
+            _exit(0);
+        }
+    }
+
+    int status, failed = 0;
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) ++failed;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &tEnd);
+    double seconds = (tEnd.tv_sec -tStart.tv_sec) +(tEnd.tv_nsec -tStart.tv_nsec)/1e9;
+
+    for (g=0; g<nGames; ++g) {
+        if (!results[g].done) {
+            fprintf(stderr, "%d workers failed, game %d wasn't played\n", failed, g);
+            return 1;
+        }
+    }
+
+    Standing standings[kMAX_ENGINES];
+    int order[kMAX_ENGINES];
+
+    rate(games, results, nGames, standings);
+
+    for (a=0; a<nEngines; ++a) {
+        for (b=a; b>0 && standings[order[b-1]].elo < standings[a].elo; --b) order[b] = order[b-1];
+        order[b] = a;
+    }
+
+    printf("%-4s %-16s %6s %6s %7s %7s %12s %12s\n", "rank", "engine", "elo", "+-95%", "games", "score", "cpu_ms/move", "nodes/move");
+    for (i=0; i<nEngines; ++i) {
+        Standing *s = &standings[order[i]];
+        printf("%-4d %-16s %6.0f %6.0f %7.0f %6.1f%% %12.3f %12.0f\n", i+1, engines[order[i]].name, s->elo, s->error, s->games,
+               100*s->score/s->games, (s->moves > 0 ? s->cpuNanos/1e6/s->moves : 0), (s->moves > 0 ? (double)s->nodes/s->moves : 0));
+    }
+
+    // Head to head, from the point of view of the first engine of the pair
+    printf("\n");
+    for (a=0; a<nEngines; ++a) {
+        for (b=a+1; b<nEngines; ++b) {
+            int wins = 0, ties = 0, losses = 0;
+            for (g=0; g<nGames; ++g) {
+                int side = (games[g].engines[0] == a ? 0 : 1);
+                if (games[g].engines[side] != a || games[g].engines[nextPlayerIndex(side)] != b) continue;
+                if (results[g].winner == -1) ++ties;
+                else if (results[g].winner == side) ++wins;
+                else ++losses;
+            }
+            if (wins +ties +losses > 0) printf("%s vs %s: +%d =%d -%d\n", engines[a].name, engines[b].name, wins, ties, losses);
+        }
+    }
+
+    fprintf(stderr, "%d games in %.1f s: %.1f games/s\n", nGames, seconds, nGames/seconds);
+
+    if (recordsPath != NULL) writeRecords(recordsPath, games, results, nGames);
+
+    return 0;
+}
+
+static BOOL parseEngine(const char *spec, Engine *engine) {
+
+    char type[16];
+    int setting, error = 0;
+
+    if (sscanf(spec, "%15[a-z]:%d:%d", type, &setting, &error) < 2 || setting < 1 || error < 0 || error > 0xFFFF) return false;
+
+    if (strcmp(type, "easy") == 0) engine->type = kCPU_EASY;
+    else if (strcmp(type, "hard") == 0) engine->type = kCPU_HARD;
+    else if (strcmp(type, "expert") == 0) engine->type = kCPU_EXPERT;
+    else return false;
+
+    if (engine->type != kCPU_EXPERT && setting > kBOARDS_CELLS) return false;
+
+    engine->name = spec;
+    engine->setting = setting;
+    engine->error = error;
+
+    return true;
+}
+
+// First field of every line of a position set, in columns from 1, skipping
+// the ones that are already won.
+static int loadOpenings(const char *path) {
+
+    FILE *file = fopen(path, "r");
+    char line[256], moves[256];
+
+    if (file == NULL) return -1;
+
+    nOpenings = 0;
+
+    while (nOpenings < kMAX_OPENINGS && fgets(line, sizeof(line), file) != NULL) {
+
+        if (line[0] == '#' || sscanf(line, "%255s", moves) != 1) continue;
+
+        Position pos;
+        int who = 0, m, n = (int)strlen(moves);
+
+        memset(&pos, 0, sizeof(Position));
+
+        for (m=0; m<n && n < kBOARDS_CELLS; ++m) {
+            int col = moves[m] -'1';
+            if (col < 0 || col >= kBOARDS_COLS || !positionCanPlay(&pos, col) || positionIsWinningMove(&pos, col, who)) break;
+            positionPlay(&pos, col, who);
+            who = nextPlayerIndex(who);
+        }
+
+        if (m == n && n < kBOARDS_CELLS) strcpy(openings[nOpenings++], moves);
+    }
+
+    fclose(file);
+
+    return nOpenings;
+}
+
+// Random columns that don't win
+static void randomOpenings(int count, int plies, Random *random) {
+
+    for (nOpenings=0; nOpenings<count; ++nOpenings) {
+
+        Position pos;
+        int who = 0, m;
+
+        memset(&pos, 0, sizeof(Position));
+
+        for (m=0; m<plies; ++m) {
+            int col;
+            do {
+                col = (int)randomBelow(random, kBOARDS_COLS);
+            } while (!positionCanPlay(&pos, col) || positionIsWinningMove(&pos, col, who));
+
+            positionPlay(&pos, col, who);
+            who = nextPlayerIndex(who);
+            openings[nOpenings][m] = '1' +col;
+        }
+
+        openings[nOpenings][m] = '\0';
+    }
+}
+
+static void playGame(const Game *game, GameResult *result) {
+
+    const char *opening = openings[game->opening];
+    Position pos;
+    Board board;
+    int who = 0;
+
+    memset(&pos, 0, sizeof(Position));
+    memset(result, 0, sizeof(GameResult));
+    result->winner = -1;
+    result->openingMoves = (int)strlen(opening);
+
+    // The mistakes come from the game's seed, as Records -p replays them
+    setCPUsSeed(game->seed);
+
+    while (pos.nMoves < kBOARDS_CELLS) {
+
+        int col;
+
+        if (pos.nMoves < result->openingMoves) {
+            col = opening[pos.nMoves] -'1';
+        } else {
+
+            const Engine *engine = &engines[game->engines[who]];
+            struct timespec tStart, tEnd;
+            uint64_t cpuStart = cpuNanos();
+
+            clock_gettime(CLOCK_MONOTONIC, &tStart);
+
+            // Both engines may be of the same type: the other side's discs
+            // just need to look like someone else's
+            char players[2];
+            players[who] = engine->type;
+            players[nextPlayerIndex(who)] = kPLAYER_2;
+            boardFromPosition(&board, &pos, players);
+
+            setCPUsMistakes(engine->error);
+            if (engine->type == kCPU_EXPERT) col = CPUsChoiceWithinTime(&board, players, who, engine->setting, engine->error > 0, NULL);
+            else col = CPUsChoice(&board, players, who, engine->setting, engine->error > 0);
+
+            result->nodes[who] += CPUsLastSearchNodes();
+
+            clock_gettime(CLOCK_MONOTONIC, &tEnd);
+            result->micros[pos.nMoves] = (uint32_t)((tEnd.tv_sec -tStart.tv_sec)*1000000 +(tEnd.tv_nsec -tStart.tv_nsec)/1000);
+            result->cpuNanos[who] += cpuNanos() -cpuStart;
+            ++(result->searched[who]);
+        }
+
+        result->moves[pos.nMoves] = (uint8_t)col;
+        ++(result->nMoves);
+
+        if (positionIsWinningMove(&pos, col, who)) {
+            result->winner = who;
+            break;
+        }
+
+        positionPlay(&pos, col, who);
+        who = nextPlayerIndex(who);
+    }
+
+    result->done = true;
+}
+
+// The board the game would show for the same moves, with players[0] first.
+static void boardFromPosition(Board *board, const Position *pos, const char players[]) {
+
+    int i, j;
+
+    board->emptyCells = kBOARDS_CELLS -pos->nMoves;
+    board->n_balls = pos->nMoves;
+
+    for (i=0; i<kBOARDS_ROWS; ++i) {
+        for (j=0; j<kBOARDS_COLS; ++j) {
+            int row = kBOARDS_ROWS -1 -i;
+            if (pos->discs[0] & bitForCell(j, row)) board->matrix[i][j] = players[0];
+            else if (pos->discs[1] & bitForCell(j, row)) board->matrix[i][j] = players[1];
+            else board->matrix[i][j] = kEMPTY;
+        }
+    }
+}
+
+static uint64_t cpuNanos() {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (uint64_t)t.tv_sec*1000000000ULL +t.tv_nsec;
+}
+
+// Bradley-Terry ratings by minorization-maximization, a tie counting as half
+// a win for each side. One virtual tie per pairing keeps the ratings finite
+// when an engine wins or loses every game. The error bars come from the
+// diagonal of the Fisher information, so they ignore the uncertainty of the
+// opponents' ratings. The ratings are centered on 0.
+static void rate(const Game *games, const GameResult *results, int count, Standing standings[]) {
+
+    static double played[kMAX_ENGINES][kMAX_ENGINES];
+    double gamma[kMAX_ENGINES], wins[kMAX_ENGINES];
+    int g, i, j, iteration;
+
+    memset(standings, 0, nEngines*sizeof(Standing));
+    memset(played, 0, sizeof(played));
+
+    for (g=0; g<count; ++g) {
+        const GameResult *r = &results[g];
+        int side;
+        for (side=0; side<2; ++side) {
+            Standing *s = &standings[games[g].engines[side]];
+            s->games += 1;
+            s->score += (r->winner == -1 ? 0.5 : (r->winner == side ? 1 : 0));
+            s->cpuNanos += r->cpuNanos[side];
+            s->nodes += r->nodes[side];
+            s->moves += r->searched[side];
+        }
+        played[games[g].engines[0]][games[g].engines[1]] += 1;
+        played[games[g].engines[1]][games[g].engines[0]] += 1;
+    }
+
+    for (i=0; i<nEngines; ++i) {
+        gamma[i] = 1;
+        wins[i] = standings[i].score;
+        for (j=0; j<nEngines; ++j) {
+            if (played[i][j] > 0) wins[i] += 0.5;
+        }
+    }
+
+    for (iteration=0; iteration<10000; ++iteration) {
+
+        double change = 0, logSum = 0;
+
+        for (i=0; i<nEngines; ++i) {
+            double denominator = 0;
+            for (j=0; j<nEngines; ++j) {
+                if (played[i][j] > 0) denominator += (played[i][j] +1)/(gamma[i] +gamma[j]);
+            }
+            double next = wins[i]/denominator;
+            change = fmax(change, fabs(log(next/gamma[i])));
+            gamma[i] = next;
+        }
+
+        for (i=0; i<nEngines; ++i) logSum += log(gamma[i]);
+        for (i=0; i<nEngines; ++i) gamma[i] /= exp(logSum/nEngines);
+
+        if (change < 1e-9) break;
+    }
+
+    for (i=0; i<nEngines; ++i) {
+        double information = 0;
+        for (j=0; j<nEngines; ++j) {
+            double p = gamma[i]/(gamma[i] +gamma[j]);
+            information += played[i][j]*p*(1 -p);
+        }
+        standings[i].elo = 400*log10(gamma[i]);
+        standings[i].error = (information > 0 ? 1.96*400/log(10)/sqrt(information) : 0);
+    }
+}
+
+static void writeRecords(const char *path, const Game *games, const GameResult *results, int count) {
+
+    FILE *file = fopen(path, "a+b");
+    RecordWriter writer;
+    int g, m;
+
+    if (file == NULL || !recordWriterInit(&writer, file)) {
+        fprintf(stderr, "%s: can't append games to it\n", path);
+        if (file != NULL) fclose(file);
+        return;
+    }
+
+    for (g=0; g<count; ++g) {
+
+        const Engine *e0 = &engines[games[g].engines[0]], *e1 = &engines[games[g].engines[1]];
+        const GameResult *r = &results[g];
+        char players[2] = {e0->type, e1->type};
+        uint16_t settings[2] = {(uint16_t)e0->setting, (uint16_t)e1->setting};
+        uint16_t mistakes[2] = {(uint16_t)e0->error, (uint16_t)e1->error};
+
+        recordBegin(&writer, players, settings, mistakes, games[g].seed, 0);
+        for (m=0; m<r->nMoves; ++m) {
+            if (m < r->openingMoves) recordOpeningMove(&writer, r->moves[m]);
+            else recordMove(&writer, r->moves[m], r->micros[m]);
+        }
+        recordEnd(&writer, (r->winner == -1 ? RecordResultTie : (r->winner == 0 ? RecordResultFirstPlayer : RecordResultSecondPlayer)));
+    }
+
+    fclose(file);
+}